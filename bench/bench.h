@@ -0,0 +1,108 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef POLICY_ENGINE_BENCH_H
+#define POLICY_ENGINE_BENCH_H
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+namespace policy_engine {
+
+struct bench_result_t {
+  std::string name;
+  uint64_t iterations;
+  double ns_per_op;
+  std::vector<std::pair<std::string, double>> counters;
+};
+
+class bench_runner_t {
+private:
+  std::string filter;
+  std::vector<bench_result_t> results;
+  std::vector<std::string> failures;
+  bool last_ran = false;
+
+public:
+  bench_runner_t(const std::string& filter="") : filter(filter) {}
+
+  bool enabled(const std::string& name) const { return filter.empty() || name.find(filter) != std::string::npos; }
+
+  // Times body(iterations), which is expected to perform that many operations.  Returns false if
+  // the benchmark was filtered out.
+  template<class F>
+  bool run(const std::string& name, uint64_t iterations, F&& body) {
+    last_ran = enabled(name);
+    if (!last_ran)
+      return false;
+    auto start = std::chrono::steady_clock::now();
+    body(iterations);
+    auto end = std::chrono::steady_clock::now();
+    double ns = std::chrono::duration<double, std::nano>(end - start).count();
+    results.push_back(bench_result_t{name, iterations, ns/iterations, {}});
+    return true;
+  }
+
+  // Attaches an extra named value to the result of the last benchmark, if it ran.
+  void counter(const std::string& name, double value) {
+    if (last_ran)
+      results.back().counters.push_back(std::make_pair(name, value));
+  }
+
+  // Records a failed self-check; the bench exits nonzero if there are any.
+  void fail(const std::string& message) { failures.push_back(message); }
+
+  const std::vector<bench_result_t>& get_results() const { return results; }
+  const std::vector<std::string>& get_failures() const { return failures; }
+};
+
+// Where the benchmarks that need configuration files find them.
+struct bench_options_t {
+  std::string soc_cfg_dir = "soc_cfg";
+  std::string soc_cfg = "soc_cfg/dover_cfg.yml";
+  std::string policy_dir; // the validator benchmarks are skipped if this isn't set
+  bool verify = false;    // also run the exhaustive decoder self-check, which isn't timed
+};
+
+// Prevents the compiler from discarding a value computed only for timing purposes.
+template<class T>
+inline void keep(const T& value) { asm volatile("" : : "r,m"(value) : "memory"); }
+
+void decoder_benchmarks(bench_runner_t& runner, const bench_options_t& options);
+void meta_cache_benchmarks(bench_runner_t& runner);
+void rule_cache_benchmarks(bench_runner_t& runner);
+void tag_bus_benchmarks(bench_runner_t& runner, const bench_options_t& options);
+void tagging_benchmarks(bench_runner_t& runner);
+void trace_benchmarks(bench_runner_t& runner);
+void validator_benchmarks(bench_runner_t& runner, const bench_options_t& options);
+
+} // namespace policy_engine
+
+#endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "bench.h"
+#include "riscv_isa.h"
+
+namespace policy_engine {
+
+static bool same_operand(const option<int>& a, const option<int>& b) {
+  return a.exists == b.exists && (!a.exists || a.get() == b.get());
+}
+
+static bool same_decode(const decoded_instruction_t& a, const decoded_instruction_t& b) {
+  return std::strcmp(a.name, b.name) == 0 && a.op == b.op &&
+    same_operand(a.rd, b.rd) && same_operand(a.rs1, b.rs1) && same_operand(a.rs2, b.rs2) && same_operand(a.rs3, b.rs3) && same_operand(a.imm, b.imm) &&
+    a.flags.has_load == b.flags.has_load && a.flags.has_store == b.flags.has_store && a.flags.has_csr_load == b.flags.has_csr_load &&
+    a.flags.has_csr_store == b.flags.has_csr_store && a.flags.is_compressed == b.flags.is_compressed;
+}
+
+// Compares the table-driven decoder against the reference decoder, recording a failure for the first
+// few mismatches.
+static void verify(bench_runner_t& runner, insn_bits_t bits, int xlen, int& mismatches) {
+  decoded_instruction_t table = decode(bits, xlen, DECODER_TABLE);
+  decoded_instruction_t reference = decode(bits, xlen, DECODER_REFERENCE);
+  if (!same_decode(table, reference) && mismatches++ < 16) {
+    char buf[128];
+    std::snprintf(buf, sizeof(buf), "RV%d decoders disagree on 0x%08x: %s vs %s", xlen, bits, table.name, reference.name);
+    runner.fail(buf);
+  }
+}
+
+static std::vector<insn_bits_t> instruction_mix(int xlen, size_t count, std::mt19937& rng) {
+  std::vector<insn_bits_t> insns;
+  while (insns.size() < count) {
+    insn_bits_t bits = (insns.size() & 1) ? (rng() & 0xffff) : (rng() | 0x3);
+    if (decode(bits, xlen, DECODER_REFERENCE))
+      insns.push_back(bits);
+  }
+  return insns;
+}
+
+// Checks the table-driven decoder against the reference decoder on every 16-bit encoding, with and
+// without junk in the upper halfword, and on random 32-bit encodings plus every
+// opcode/funct3/funct7 combination.  That's millions of decodes, so it only runs with --verify.
+static void verify_decoder(bench_runner_t& runner, int xlen) {
+  std::mt19937 rng(xlen);
+  int mismatches = 0;
+  for (insn_bits_t bits = 0; bits < 0x10000; bits++) {
+    verify(runner, bits, xlen, mismatches);
+    verify(runner, bits | (rng() << 16), xlen, mismatches);
+  }
+  for (int i = 0; i < (1 << 22); i++)
+    verify(runner, rng() | 0x3, xlen, mismatches);
+  for (insn_bits_t opcode = 0; opcode < 0x80; opcode++)
+    for (insn_bits_t funct = 0; funct < 0x400; funct++)
+      verify(runner, opcode | (funct & 0x7) << 12 | (funct >> 3) << 25 | (rng() & 0x01ff8f80), xlen, mismatches);
+  if (mismatches > 16)
+    runner.fail("RV" + std::to_string(xlen) + " decoders disagree on " + std::to_string(mismatches) + " encodings in all");
+}
+
+void decoder_benchmarks(bench_runner_t& runner, const bench_options_t& options) {
+  std::mt19937 rng(0x5eed);
+  for (int xlen : {32, 64}) {
+    std::string rv = "RV" + std::to_string(xlen);
+    if (options.verify && runner.enabled("decoder/verify/" + rv))
+      verify_decoder(runner, xlen);
+
+    std::vector<insn_bits_t> insns = instruction_mix(xlen, 1 << 14, rng);
+    for (decoder_mode_t mode : {DECODER_TABLE, DECODER_REFERENCE}) {
+      std::string name = mode == DECODER_TABLE ? "table" : "reference";
+      runner.run("decoder/throughput/" + name + "/" + rv, 1 << 23, [&](uint64_t n) {
+        for (uint64_t i = 0; i < n; i++) {
+          decoded_instruction_t inst = decode(insns[i & (insns.size() - 1)], xlen, mode);
+          keep(inst.op);
+        }
+      });
+    }
+  }
+}
+
+} // namespace policy_engine
@@ -0,0 +1,144 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstdio>
+#include <string>
+#include "bench.h"
+
+using namespace policy_engine;
+
+static void usage(const char* name) {
+  printf("usage: %s [options] [filter]\n", name);
+  printf("  runs every benchmark whose name contains filter (all of them if omitted)\n");
+  printf("  --json FILE          also write results to FILE as JSON (- for stdout instead of the table)\n");
+  printf("  --soc-cfg-dir DIR    SOC layouts for the tag bus benchmarks (default soc_cfg)\n");
+  printf("  --soc-cfg FILE       SOC layout for the validator benchmarks (default soc_cfg/dover_cfg.yml)\n");
+  printf("  --policy-dir DIR     generated policy for the validator benchmarks, which are skipped without one\n");
+  printf("  --verify             check the table-driven decoder against the reference decoder first\n");
+}
+
+static std::string json_string(const std::string& s) {
+  std::string out = "\"";
+  for (char c : s) {
+    if (c == '"' || c == '\\')
+      out += '\\';
+    out += c;
+  }
+  return out + "\"";
+}
+
+static void print_json(std::FILE* out, const bench_runner_t& runner) {
+  fprintf(out, "{\n  \"benchmarks\": [");
+  const char* sep = "\n";
+  for (const bench_result_t& r : runner.get_results()) {
+    fprintf(out, "%s    {\"name\": %s, \"iterations\": %lu, \"ns_per_op\": %.3f", sep, json_string(r.name).c_str(), r.iterations, r.ns_per_op);
+    if (!r.counters.empty()) {
+      fprintf(out, ", \"counters\": {");
+      const char* counter_sep = "";
+      for (const auto& [ name, value ] : r.counters) {
+        fprintf(out, "%s%s: %.6g", counter_sep, json_string(name).c_str(), value);
+        counter_sep = ", ";
+      }
+      fprintf(out, "}");
+    }
+    fprintf(out, "}");
+    sep = ",\n";
+  }
+  fprintf(out, "\n  ],\n  \"failures\": [");
+  sep = "\n";
+  for (const std::string& failure : runner.get_failures()) {
+    fprintf(out, "%s    %s", sep, json_string(failure).c_str());
+    sep = ",\n";
+  }
+  fprintf(out, "\n  ]\n}\n");
+}
+
+static void print_table(const bench_runner_t& runner) {
+  for (const bench_result_t& r : runner.get_results()) {
+    printf("%-48s %12lu iters %10.2f ns/op", r.name.c_str(), r.iterations, r.ns_per_op);
+    for (const auto& [ name, value ] : r.counters)
+      printf("  %s=%g", name.c_str(), value);
+    printf("\n");
+  }
+
+  for (const std::string& failure : runner.get_failures())
+    printf("FAILED: %s\n", failure.c_str());
+}
+
+int main(int argc, char* argv[]) {
+  std::string filter;
+  bench_options_t options;
+  std::string json;
+  for (int i = 1; i < argc; i++) {
+    std::string arg(argv[i]);
+    if (arg == "-h" || arg == "--help") {
+      usage(argv[0]);
+      return 0;
+    } else if (arg == "--verify") {
+      options.verify = true;
+    } else if ((arg == "--json" || arg == "--soc-cfg-dir" || arg == "--soc-cfg" || arg == "--policy-dir") && i + 1 < argc) {
+      std::string value(argv[++i]);
+      if (arg == "--json")
+        json = value;
+      else if (arg == "--soc-cfg-dir")
+        options.soc_cfg_dir = value;
+      else if (arg == "--soc-cfg")
+        options.soc_cfg = value;
+      else
+        options.policy_dir = value;
+    } else if (arg.rfind("--", 0) == 0) {
+      usage(argv[0]);
+      return 1;
+    } else {
+      filter = arg;
+    }
+  }
+
+  bench_runner_t runner(filter);
+  decoder_benchmarks(runner, options);
+  meta_cache_benchmarks(runner);
+  rule_cache_benchmarks(runner);
+  tag_bus_benchmarks(runner, options);
+  tagging_benchmarks(runner);
+  trace_benchmarks(runner);
+  validator_benchmarks(runner, options);
+
+  if (json == "-") {
+    print_json(stdout, runner);
+  } else {
+    print_table(runner);
+    if (!json.empty()) {
+      std::FILE* out = std::fopen(json.c_str(), "w");
+      if (!out) {
+        std::fprintf(stderr, "can't write %s\n", json.c_str());
+        return 1;
+      }
+      print_json(out, runner);
+      std::fclose(out);
+    }
+  }
+  return runner.get_failures().empty() ? 0 : 1;
+}
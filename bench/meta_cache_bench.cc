@@ -0,0 +1,99 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_set>
+#include <vector>
+#include "bench.h"
+#include "meta_cache.h"
+#include "metadata.h"
+#include "policy_meta_set.h"
+
+namespace policy_engine {
+
+static std::vector<meta_set_t> random_meta_sets(size_t count, std::mt19937_64& rng) {
+  std::vector<meta_set_t> sets;
+  sets.reserve(count);
+  meta_set_cache_t seen;
+  while (sets.size() < count) {
+    meta_set_t ms{0};
+    for (int i = 0; i < META_SET_WORDS; i++)
+      ms.tags[i] = rng();
+    if (seen.canonize(ms) == seen.size())
+      sets.push_back(ms);
+  }
+  return sets;
+}
+
+// Lookups of already-interned sets (the rule cache miss path) should cost the same no matter how
+// many sets have been interned.
+void meta_cache_benchmarks(bench_runner_t& runner) {
+  std::mt19937_64 rng(0x5eed);
+  for (size_t count : {16, 256, 1024, 4096, 16384}) {
+    std::vector<meta_set_t> sets = random_meta_sets(count, rng);
+
+    meta_set_cache_t cache;
+    runner.run("meta_cache/intern/" + std::to_string(count), count, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++)
+        keep(cache.canonize(sets[i]));
+    });
+
+    std::vector<uint32_t> order(1 << 16);
+    for (uint32_t& i : order)
+      i = rng() % count;
+    runner.run("meta_cache/lookup/" + std::to_string(count), 1 << 22, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++)
+        keep(cache.canonize(sets[order[i & (order.size() - 1)]]));
+    });
+    runner.counter("sets", cache.size());
+  }
+
+  // The tagging tools build a metadata set for each range by unioning the sets of every entity that
+  // covers it, then intern it by hash.
+  std::vector<metadata_t> mds(1024);
+  for (metadata_t& md : mds) {
+    for (int i = rng() % 6; i >= 0; i--)
+      md.insert((meta_t)(rng() % 64));
+  }
+  runner.run("metadata/union", 1 << 20, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      metadata_t md(mds[i & (mds.size() - 1)]);
+      md.insert(&mds[(i*7 + 1) & (mds.size() - 1)]);
+      keep(md.hash);
+    }
+  });
+
+  std::unordered_set<metadata_t> distinct(mds.begin(), mds.end());
+  std::unordered_set<size_t> hashes;
+  for (const metadata_t& md : distinct)
+    hashes.insert(md.hash);
+  if (hashes.size() != distinct.size())
+    runner.fail("metadata: " + std::to_string(distinct.size() - hashes.size()) + " hash collisions among " + std::to_string(distinct.size()) + " sets");
+}
+
+} // namespace policy_engine
@@ -0,0 +1,204 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cmath>
+#include <cstdint>
+#include <random>
+#include <string>
+#include <unordered_map>
+#include <vector>
+#include "bench.h"
+#include "dmhc_rule_cache.h"
+#include "finite_rule_cache.h"
+#include "ideal_rule_cache.h"
+#include "riscv_isa.h"
+#include "rule_table.h"
+
+namespace policy_engine {
+
+// The hash riscv_isa.h used to provide, kept for comparison.
+struct xor_operands_hash_t {
+  size_t operator ()(const operands_t& ops) const {
+    return ops.pc ^ ops.ci << 1 ^ ops.op1 << 2 ^ ops.op2 << 3 ^ ops.op3 << 4 ^ ops.mem << 5;
+  }
+};
+
+/**
+ * Operand tuples shaped like the ones a policy sees: a few hundred instruction tags, a few dozen
+ * register and memory tags, and many instructions that don't use every operand.
+ */
+static std::vector<operands_t> make_rules(size_t count, std::mt19937_64& rng) {
+  std::unordered_map<operands_t, bool> seen;
+  std::vector<operands_t> rules;
+  auto tag = [&](tag_t n) { return (tag_t)(rng() % 4 == 0 ? BAD_TAG_VALUE : 1 + rng() % n); };
+  while (rules.size() < count) {
+    operands_t ops{1 + rng() % 4, 1 + rng() % 512, tag(48), tag(48), BAD_TAG_VALUE, tag(32)};
+    if (seen.emplace(ops, true).second)
+      rules.push_back(ops);
+  }
+  return rules;
+}
+
+// Skewed so a small set of hot rules accounts for most lookups, like a loop-heavy program.
+static std::vector<uint32_t> make_stream(size_t rules, size_t length, std::mt19937_64& rng) {
+  std::vector<uint32_t> stream(length);
+  std::uniform_real_distribution<double> u(0, 1);
+  for (uint32_t& i : stream)
+    i = (uint32_t)(std::pow(u(rng), 3)*rules);
+  return stream;
+}
+
+template<class Map>
+static void map_benchmarks(bench_runner_t& runner, const std::string& name, const std::vector<operands_t>& rules,
+                           const std::vector<operands_t>& absent, const std::vector<uint32_t>& stream) {
+  Map map;
+  results_t res{1, 1, 1, true, true, true};
+  for (const operands_t& ops : rules)
+    map[ops] = res;
+  std::string suffix = "/" + std::to_string(rules.size());
+  runner.run("rule_cache/hit/" + name + suffix, 1 << 22, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      keep(map.find(rules[stream[i & (stream.size() - 1)]])->second.rd);
+  });
+  runner.run("rule_cache/miss/" + name + suffix, 1 << 22, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      keep(map.find(absent[i & (absent.size() - 1)]) == map.end());
+  });
+}
+
+static void table_benchmarks(bench_runner_t& runner, const std::vector<operands_t>& rules,
+                             const std::vector<operands_t>& absent, const std::vector<uint32_t>& stream) {
+  rule_table_t table;
+  results_t res{1, 1, 1, true, true, true};
+  for (const operands_t& ops : rules)
+    table.insert(ops, res);
+  std::string suffix = "/" + std::to_string(rules.size());
+  runner.run("rule_cache/hit/rule_table" + suffix, 1 << 22, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      keep(table.results(table.find(rules[stream[i & (stream.size() - 1)]])).rd);
+  });
+  runner.run("rule_cache/miss/rule_table" + suffix, 1 << 22, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++)
+      keep(table.find(absent[i & (absent.size() - 1)]) == rule_table_t::npos);
+  });
+
+  for (const operands_t& ops : rules) {
+    if (table.find(ops) == rule_table_t::npos) {
+      runner.fail("rule_table_t lost a rule");
+      break;
+    }
+  }
+  for (const operands_t& ops : absent) {
+    if (table.find(ops) != rule_table_t::npos) {
+      runner.fail("rule_table_t found a rule that was never installed");
+      break;
+    }
+  }
+}
+
+/**
+ * The rule_cache_t interface the validator uses: hits on rules already installed, and the probe then
+ * install_rule() sequence of a miss.  The mixed stream has more distinct rules than a finite cache
+ * holds, so it measures eviction as well as the hit rate.
+ */
+static void cache_benchmarks(bench_runner_t& runner, const std::string& name, rule_cache_t* cache, uint64_t iterations,
+                             const std::vector<operands_t>& rules, const std::vector<uint32_t>& hot_stream,
+                             const std::vector<operands_t>& absent,
+                             const std::vector<operands_t>& mixed, const std::vector<uint32_t>& mixed_stream) {
+  results_t res{1, 1, 1, true, true, true};
+  for (const operands_t& ops : rules)
+    cache->install_rule(ops, res);
+  runner.run("rule_cache/allow/" + name, iterations, [&](uint64_t n) {
+    results_t out;
+    for (uint64_t i = 0; i < n; i++)
+      keep(cache->allow(rules[hot_stream[i & (hot_stream.size() - 1)]], out));
+  });
+  runner.run("rule_cache/install/" + name, absent.size(), [&](uint64_t n) {
+    results_t out;
+    rule_cache_hint_t hint;
+    for (uint64_t i = 0; i < n; i++) {
+      if (!cache->probe(absent[i], out, hint))
+        cache->install_rule(hint, absent[i], res);
+    }
+  });
+
+  cache->flush();
+  uint64_t hits = 0;
+  runner.run("rule_cache/mixed/" + name, iterations, [&](uint64_t n) {
+    results_t out;
+    rule_cache_hint_t hint;
+    for (uint64_t i = 0; i < n; i++) {
+      const operands_t& ops = mixed[mixed_stream[i & (mixed_stream.size() - 1)]];
+      if (cache->probe(ops, out, hint))
+        hits++;
+      else
+        cache->install_rule(hint, ops, res);
+    }
+  });
+  runner.counter("hit_rate", (double)hits/iterations);
+
+  cache->flush();
+  results_t out;
+  cache->install_rule(rules[0], res);
+  if (!cache->allow(rules[0], out) || out.rd != res.rd)
+    runner.fail(name + " rule cache lost a rule it just installed");
+}
+
+void rule_cache_benchmarks(bench_runner_t& runner) {
+  std::mt19937_64 rng(0x5eed);
+  for (size_t count : {256, 4096, 65536}) {
+    std::vector<operands_t> all = make_rules(count + 4096, rng);
+    std::vector<operands_t> rules(all.begin(), all.begin() + count);
+    std::vector<operands_t> absent(all.begin() + count, all.end());
+    std::vector<uint32_t> stream = make_stream(count, 1 << 16, rng);
+
+    table_benchmarks(runner, rules, absent, stream);
+    map_benchmarks<std::unordered_map<operands_t, results_t>>(runner, "unordered_map", rules, absent, stream);
+    map_benchmarks<std::unordered_map<operands_t, results_t, xor_operands_hash_t>>(runner, "unordered_map_xor_hash", rules, absent, stream);
+  }
+
+  // 256 hot rules fit in every cache; the 4096 rules of the mixed stream don't fit in the finite ones.
+  // DMHC models the hardware's hashing bit by bit, so it gets far fewer iterations.  It also asserts if
+  // it has to overwrite a hash slot that's still in use, which can happen once it's much more than
+  // half full, so its rules are kept to half its capacity and it's never made to evict.
+  std::vector<operands_t> all = make_rules(4096 + (1 << 16), rng);
+  std::vector<operands_t> rules(all.begin(), all.begin() + 256);
+  std::vector<operands_t> mixed(all.begin(), all.begin() + 4096);
+  std::vector<operands_t> absent(all.begin() + 4096, all.end());
+  std::vector<operands_t> dmhc_absent(absent.begin(), absent.begin() + 256);
+  std::vector<operands_t> dmhc_mixed(all.begin(), all.begin() + 512);
+  std::vector<uint32_t> hot_stream = make_stream(rules.size(), 1 << 16, rng);
+  std::vector<uint32_t> mixed_stream = make_stream(mixed.size(), 1 << 16, rng);
+  std::vector<uint32_t> dmhc_mixed_stream = make_stream(dmhc_mixed.size(), 1 << 16, rng);
+  ideal_rule_cache_t ideal;
+  cache_benchmarks(runner, "ideal", &ideal, 1 << 22, rules, hot_stream, absent, mixed, mixed_stream);
+  finite_rule_cache_t finite(1024);
+  cache_benchmarks(runner, "finite/1024", &finite, 1 << 22, rules, hot_stream, absent, mixed, mixed_stream);
+  dmhc_rule_cache_t dmhc(1024, DMHC_RULE_CACHE_IWIDTH, DMHC_RULE_CACHE_OWIDTH, DMHC_RULE_CACHE_K, DMHC_RULE_CACHE_NO_EVICT);
+  cache_benchmarks(runner, "dmhc/1024", &dmhc, 1 << 14, rules, hot_stream, dmhc_absent, dmhc_mixed, dmhc_mixed_stream);
+}
+
+} // namespace policy_engine
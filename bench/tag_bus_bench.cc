@@ -0,0 +1,395 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <stdexcept>
+#include <unistd.h>
+#include <string>
+#include <tuple>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "bench.h"
+#include "code_tag_table.h"
+#include "insn_cache.h"
+#include "policy_meta_set.h"
+#include "soc_tag_configuration.h"
+#include "tag_utils.h"
+
+namespace policy_engine {
+
+using soc_element_t = soc_tag_configuration_t::soc_element_t;
+
+// Reads the elements out of an SOC configuration the same way soc_tag_configuration_t does, without
+// needing a policy to look up their tags.
+static std::vector<soc_element_t> load_layout(const std::string& path, int xlen) {
+  std::vector<soc_element_t> regions;
+  YAML::Node n = YAML::LoadFile(path);
+  tag_t tag = 1;
+  for (const auto& it : n["SOC"]) {
+    const YAML::Node& e = it.second;
+    soc_element_t region;
+    region.start = e["start"].as<address_t>();
+    region.end = e["end"].as<address_t>();
+    region.tag_granularity = e["tag_granularity"] ? e["tag_granularity"].as<size_t>() : xlen/8;
+    region.word_size = xlen/8;
+    region.heterogeneous = e["heterogeneous"] && e["heterogeneous"].as<bool>();
+    if (e["tag_storage"] && e["tag_storage"].as<std::string>() == "interval")
+      region.storage = soc_tag_configuration_t::INTERVAL;
+    region.tag = tag++;
+    regions.push_back(region);
+  }
+  return regions;
+}
+
+// resident set size of this process, from /proc
+static double resident_mb() {
+  long pages = 0, resident = 0;
+  if (std::FILE* f = std::fopen("/proc/self/statm", "r")) {
+    if (std::fscanf(f, "%ld %ld", &pages, &resident) != 2)
+      resident = 0;
+    std::fclose(f);
+  }
+  return (double)resident*sysconf(_SC_PAGESIZE)/(1 << 20);
+}
+
+static void layout_benchmarks(bench_runner_t& runner, const std::string& name, const std::vector<soc_element_t>& regions) {
+  // Startup cost and the memory taken by the tags before the guest runs.
+  tag_bus_t tag_bus;
+  double before = resident_mb();
+  auto build = [&](uint64_t) {
+    for (const soc_element_t& r : regions)
+      tag_bus.add_provider(r.start, r.end, soc_tag_configuration_t::make_provider(r));
+  };
+  if (!runner.run("tag_bus/startup/" + name, 1, build))
+    build(1);
+  runner.counter("resident_mb", resident_mb() - before);
+
+  // Accesses spread over every region, like a program touching devices as well as memory, and
+  // accesses confined to a 64KiB working set in the largest heterogeneous region.  Some layouts
+  // have regions that overlap, and the parts of the outer region past the inner one can't be
+  // reached through the bus, so those addresses are left out.
+  auto mapped = [&](address_t addr) {
+    tag_t tag;
+    return tag_bus.load_data_tag(addr, tag);
+  };
+  std::mt19937_64 rng(0x5eed);
+  std::vector<address_t> scattered;
+  while (scattered.size() < (1 << 16)) {
+    const soc_element_t& r = regions[rng() % regions.size()];
+    if (address_t addr = r.start + (rng() % (r.end - r.start) & -4); mapped(addr))
+      scattered.push_back(addr);
+  }
+  std::vector<address_t> local;
+  const soc_element_t* ram = nullptr;
+  for (const soc_element_t& r : regions)
+    if (r.heterogeneous && mapped(r.start) && (!ram || r.end - r.start > ram->end - ram->start))
+      ram = &r;
+  if (ram) {
+    address_t span = std::min<address_t>(ram->end - ram->start, 0x10000);
+    for (int tries = 0; local.size() < (1 << 16) && tries < (1 << 20); tries++)
+      if (address_t addr = ram->start + (rng() % span & -4); mapped(addr))
+        local.push_back(addr);
+    if (local.size() < (1 << 16))
+      local.clear();
+  }
+
+  for (const auto& [ stream_name, stream ] : {std::make_pair("scattered", &scattered), std::make_pair("local", &local)}) {
+    if (stream->empty())
+      continue;
+    const std::vector<address_t>& addrs = *stream;
+    runner.run("tag_bus/load_data_tag/" + name + "/" + stream_name, 1 << 22, [&](uint64_t n) {
+      tag_t tag = 0;
+      for (uint64_t i = 0; i < n; i++)
+        keep(tag_bus.load_data_tag(addrs[i & (addrs.size() - 1)], tag) + tag);
+    });
+    runner.run("tag_bus/load_insn_tag/" + name + "/" + stream_name, 1 << 22, [&](uint64_t n) {
+      tag_t tag = 0;
+      for (uint64_t i = 0; i < n; i++)
+        keep(tag_bus.load_insn_tag(addrs[i & (addrs.size() - 1)], tag) + tag);
+    });
+  }
+
+  for (address_t addr : scattered) {
+    tag_t data, insn;
+    if (!tag_bus.load_data_tag(addr, data) || !tag_bus.load_insn_tag(addr, insn) || data != insn) {
+      runner.fail("tag_bus_t found different data and instruction tags in a freshly tagged region in " + name);
+      break;
+    }
+  }
+
+  // Stores of changing tags, which give pages of a paged region their own copies the first time.
+  if (!local.empty()) {
+    runner.run("tag_bus/store_data_tag/" + name + "/local", 1 << 22, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++)
+        keep(tag_bus.store_data_tag(local[i & (local.size() - 1)], 100 + (i & 7)));
+    });
+    for (uint64_t i = (1 << 22) - local.size(); i < (1 << 22); i++) {
+      tag_t tag;
+      if (runner.enabled("tag_bus/store_data_tag/" + name + "/local") &&
+          (!tag_bus.load_data_tag(local[i & (local.size() - 1)], tag) || tag < 100)) {
+        runner.fail("tag_bus_t lost a stored tag in " + name);
+        break;
+      }
+    }
+  }
+}
+
+// A 1MiB heap that starts out with one tag and has one word in every `spread` given another of 8
+// tags, kept densely and as runs.  bytes is roughly what each takes to hold the tags.
+static void storage_benchmarks(bench_runner_t& runner, size_t spread) {
+  static constexpr address_t base = 0x80000000, size = 1 << 20;
+  std::string level = "1in" + std::to_string(spread);
+  std::string dense_name = "tag_bus/load_data_tag/dense/" + level, interval_name = "tag_bus/load_data_tag/interval/" + level;
+  if (!runner.enabled(dense_name) && !runner.enabled(interval_name))
+    return;
+
+  auto dense = std::make_unique<platform_ram_tag_provider_t>(size, 1, 4);
+  auto interval = std::make_unique<interval_tag_provider_t>(size, 1, 4);
+  std::mt19937_64 rng(spread);
+  for (address_t word = 0; word < size; word += 4) {
+    if (rng() % spread == 0) {
+      tag_t tag = 2 + rng() % 8;
+      dense->store_data_tag(word, tag);
+      interval->store_data_tag(word, tag);
+    }
+  }
+  double dense_bytes = (double)size/4*dense->tag_width(), interval_bytes = (double)interval->run_count()*48;
+
+  std::vector<address_t> addrs(1 << 16);
+  for (address_t& addr : addrs)
+    addr = base + (rng() % size & -4);
+  tag_bus_t dense_bus, interval_bus;
+  dense_bus.add_provider(base, base + size, std::move(dense));
+  interval_bus.add_provider(base, base + size, std::move(interval));
+
+  for (const auto& [ name, bus, bytes ] : {std::make_tuple(dense_name, &dense_bus, dense_bytes), std::make_tuple(interval_name, &interval_bus, interval_bytes)}) {
+    runner.run(name, 1 << 22, [&](uint64_t n) {
+      tag_t tag = 0;
+      for (uint64_t i = 0; i < n; i++)
+        keep(bus->load_data_tag(addrs[i & (addrs.size() - 1)], tag) + tag);
+    });
+    runner.counter("bytes", bytes);
+  }
+
+  for (address_t addr : addrs) {
+    tag_t a, b;
+    if (!dense_bus.load_data_tag(addr, a) || !interval_bus.load_data_tag(addr, b) || a != b) {
+      runner.fail("interval_tag_provider_t and platform_ram_tag_provider_t disagree at " + level);
+      break;
+    }
+  }
+}
+
+// Applying startup metadata to 4MiB of code in 4KiB ranges with alternating tags, a word at a time
+// the way the validator used to and with fill_range().
+static void fill_benchmarks(bench_runner_t& runner) {
+  static constexpr address_t base = 0x80000000, size = 16 << 20, code = 4 << 20, range = 4 << 10;
+  for (bool bulk : {false, true}) {
+    std::string name = std::string("tag_bus/apply_metadata/") + (bulk ? "fill_range" : "store_insn_tag");
+    tag_bus_t tag_bus;
+    tag_bus.add_provider(base, base + size, std::make_unique<paged_tag_provider_t>(size, 1, 4));
+    bool ok = true;
+    bool ran = runner.run(name, 16, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++) {
+        for (address_t start = base; start < base + code; start += range) {
+          tag_t tag = 2 + (start/range + i) % 2;
+          if (bulk) {
+            ok &= tag_bus.fill_range(start, start + range, tag);
+          } else {
+            for (address_t addr = start; addr < start + range; addr += 4)
+              ok &= tag_bus.store_insn_tag(addr, tag);
+          }
+        }
+      }
+    });
+    tag_t tag;
+    if (ran && (!ok || !tag_bus.load_insn_tag(base + code - 4, tag) || tag != 2 + (code/range - 1 + 15) % 2))
+      runner.fail(name + " didn't tag the code");
+  }
+}
+
+// Stores to a heap the way commit() does them, invalidating the predecoded instructions that took
+// their CI tag from the words each store changes, in each kind of heterogeneous storage.  Code cached
+// from the start of the region has to stay valid through stores to the rest of it, and a store to a
+// word holding cached code has to drop it.
+static void insn_cache_benchmarks(bench_runner_t& runner) {
+  static constexpr address_t base = 0x80000000, size = 1 << 20, code = 8 << 10;
+  std::vector<std::pair<std::string, std::unique_ptr<tag_provider_t>>> kinds;
+  kinds.emplace_back("dense", std::make_unique<platform_ram_tag_provider_t>(size, 1, 4));
+  kinds.emplace_back("paged", std::make_unique<paged_tag_provider_t>(size, 1, 4));
+  kinds.emplace_back("interval", std::make_unique<interval_tag_provider_t>(size, 1, 4));
+  for (auto& [ kind, provider ] : kinds) {
+    std::string name = "tag_bus/store_invalidate/" + kind;
+    if (!runner.enabled(name))
+      continue;
+    tag_bus_t tag_bus;
+    tag_bus.add_provider(base, base + size, std::move(provider));
+    insn_cache_t insn_cache;
+    for (address_t pc = base; pc < base + code; pc += 4) {
+      predecoded_insn_t& entry = insn_cache.slot(pc);
+      entry = predecoded_insn_t{};
+      entry.pc = pc;
+      entry.bits = pc;
+      entry.valid = true;
+    }
+    std::mt19937_64 rng(0x5eed);
+    std::vector<address_t> heap(1 << 16);
+    for (address_t& addr : heap)
+      addr = base + code + (rng() % (size - code) & -4);
+
+    runner.run(name, 1 << 22, [&](uint64_t n) {
+      for (uint64_t i = 0; i < n; i++) {
+        address_t addr = heap[i & (heap.size() - 1)];
+        if (tag_bus.store_data_tag(addr, 2 + (i & 7))) {
+          address_t start, end;
+          tag_bus.data_tag_span(addr, start, end);
+          insn_cache.invalidate(start, end);
+        }
+      }
+    });
+    for (address_t pc = base; pc < base + code; pc += 4) {
+      if (!insn_cache.lookup(pc, pc)) {
+        runner.fail("a heap store invalidated unrelated cached code in " + kind + " storage");
+        break;
+      }
+    }
+
+    address_t start, end;
+    tag_bus.store_data_tag(base, 2);
+    tag_bus.data_tag_span(base, start, end);
+    insn_cache.invalidate(start, end);
+    if (insn_cache.lookup(base, base) || !insn_cache.lookup(base + 4, base + 4))
+      runner.fail("a store to cached code in " + kind + " storage didn't invalidate just that instruction");
+  }
+}
+
+// CI tag lookups for a program that runs straight through basic blocks of 8 instructions at random
+// places in 1MiB of code in flash, while storing to RAM, from the tag bus and from a
+// code_tag_table_t built over the code.  Flash has 8-byte tag granules, so a store to code changes
+// one of a granule's two instruction tags, and resyncing the span the bus reports has to keep the
+// table in step with it.
+static void fetch_benchmarks(bench_runner_t& runner) {
+  static constexpr address_t flash = 0x20000000, ram = 0x80000000, size = 64 << 20, code = 1 << 20;
+  if (!runner.enabled("tag_bus/fetch/tag_bus") && !runner.enabled("tag_bus/fetch/code_tag_table"))
+    return;
+  tag_bus_t tag_bus;
+  tag_bus.add_provider(flash, flash + size, std::make_unique<paged_tag_provider_t>(size, 1, 8));
+  tag_bus.add_provider(ram, ram + size, std::make_unique<paged_tag_provider_t>(size, 1, 4));
+  std::mt19937_64 rng(0xc0de);
+  for (address_t start = flash; start < flash + code; start += 256)
+    tag_bus.fill_range(start, start + 256, 2 + rng() % 16);
+  code_tag_table_t code_tags;
+  code_tags.build({range_t{flash, flash + code}}, tag_bus);
+
+  std::vector<address_t> pcs, stores;
+  while (pcs.size() < (1 << 16)) {
+    address_t block = flash + (rng() % code & -32);
+    for (address_t pc = block; pc < block + 32; pc += 4)
+      pcs.push_back(pc);
+    stores.push_back(ram + (rng() % size & -4));
+  }
+
+  auto fetch = [&](bool table) {
+    return [&, table](uint64_t n) {
+      tag_t tag = 0;
+      for (uint64_t i = 0; i < n; i++) {
+        address_t pc = pcs[i & (pcs.size() - 1)];
+        if (!table || !code_tags.load(pc, tag))
+          tag_bus.load_insn_tag(pc, tag);
+        keep(tag);
+        if (i % 8 == 0)
+          tag_bus.store_data_tag(stores[(i/8) & (stores.size() - 1)], 20 + (i & 3));
+      }
+    };
+  };
+  runner.run("tag_bus/fetch/tag_bus", 1 << 22, fetch(false));
+  runner.run("tag_bus/fetch/code_tag_table", 1 << 22, fetch(true));
+
+  for (size_t i = 0; i < 1024; i++) {
+    address_t addr = pcs[rng() % pcs.size()], start, end;
+    tag_bus.store_data_tag(addr, 40 + i % 4);
+    tag_bus.data_tag_span(addr, start, end);
+    code_tags.resync(start, end, tag_bus);
+  }
+  for (address_t pc : pcs) {
+    tag_t a, b;
+    if (!code_tags.load(pc, a) || !tag_bus.load_insn_tag(pc, b) || a != b) {
+      runner.fail("code_tag_table_t doesn't match the tag bus");
+      break;
+    }
+  }
+
+  // code in two regions less than max_gap apart, with nothing mapped in between
+  tag_bus_t split_bus;
+  split_bus.add_provider(flash, flash + 0x1000, std::make_unique<platform_ram_tag_provider_t>(0x1000, 2, 4));
+  split_bus.add_provider(flash + 0x1800, flash + 0x2800, std::make_unique<platform_ram_tag_provider_t>(0x1000, 3, 4));
+  code_tag_table_t split_tags;
+  split_tags.build({range_t{flash, flash + 0x1000}, range_t{flash + 0x1800, flash + 0x2800}}, split_bus);
+  tag_t tag;
+  if (split_tags.size() != 0x800 || !split_tags.load(flash + 0x1800, tag) || tag != 3 || split_tags.load(flash + 0x1000, tag))
+    runner.fail("code_tag_table_t dropped the code past a gap between tag bus regions");
+}
+
+// One set of lookups per SOC layout, then dense and interval storage at several levels of tag
+// entropy.
+void tag_bus_benchmarks(bench_runner_t& runner, const bench_options_t& options) {
+  std::vector<std::filesystem::path> paths;
+  std::error_code ec;
+  for (const auto& entry : std::filesystem::directory_iterator(options.soc_cfg_dir, ec))
+    if (entry.path().extension() == ".yml")
+      paths.push_back(entry.path());
+  if (ec) {
+    std::fprintf(stderr, "tag_bus: can't read %s: %s\n", options.soc_cfg_dir.c_str(), ec.message().c_str());
+    return;
+  }
+  std::sort(paths.begin(), paths.end());
+
+  for (const std::filesystem::path& path : paths) {
+    std::string name = path.stem().string();
+    bool wanted = runner.enabled("tag_bus/startup/" + name) || runner.enabled("tag_bus/store_data_tag/" + name + "/local");
+    for (const char* kind : {"load_data_tag", "load_insn_tag"})
+      for (const char* stream : {"scattered", "local"})
+        wanted |= runner.enabled(std::string("tag_bus/") + kind + "/" + name + "/" + stream);
+    if (!wanted)
+      continue;
+    std::vector<soc_element_t> regions = load_layout(path.string(), 32);
+    if (!regions.empty())
+      layout_benchmarks(runner, name, regions);
+  }
+
+  for (size_t spread : {4096, 256, 16, 2})
+    storage_benchmarks(runner, spread);
+  fill_benchmarks(runner);
+  insn_cache_benchmarks(runner);
+  fetch_benchmarks(runner);
+}
+
+} // namespace policy_engine
@@ -0,0 +1,264 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <algorithm>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <fstream>
+#include <random>
+#include <set>
+#include <string>
+#include <thread>
+#include <unordered_set>
+#include <vector>
+#include <unistd.h>
+#include "bench.h"
+#include "metadata.h"
+#include "metadata_factory.h"
+#include "metadata_index_map.h"
+#include "metadata_memory_map.h"
+#include "range.h"
+#include "range_map.h"
+#include "reporter.h"
+#include "riscv_isa.h"
+
+namespace policy_engine {
+
+static const int meta_count = 64;
+static const int group_count = 8;
+static const address_t image_base = 0x80000000;
+
+struct image_range_t {
+  range_t range;
+  std::vector<std::string> tags;
+};
+
+static std::string meta_name(int i) { return "bench.m" + std::to_string(i); }
+
+// A random instruction stream of mixed 16- and 32-bit encodings, padded so tag_opcodes() can read a
+// whole insn_bits_t at the last one.
+static std::vector<uint8_t> random_text(size_t size, std::mt19937& rng, std::set<std::string>& mnemonics) {
+  std::vector<uint8_t> text(size + sizeof(insn_bits_t), 0);
+  for (size_t pc = 0; pc < size;) {
+    bool compressed = (rng() & 1) || size - pc < 4;
+    insn_bits_t bits = compressed ? (rng() & 0xffff) : (rng() | 0x3);
+    decoded_instruction_t inst = decode(bits, 32);
+    if (!inst || inst.flags.is_compressed != compressed)
+      continue;
+    mnemonics.insert(inst.name);
+    for (int i = 0; i < (compressed ? 2 : 4); i++)
+      text[pc++] = bits >> 8*i;
+  }
+  return text;
+}
+
+// A policy with meta_count metadata and a group for every mnemonic in the text, in the files
+// metadata_factory_t reads.
+static std::string write_policy(const std::set<std::string>& mnemonics) {
+  char dir[] = "/tmp/policy_engine_bench.XXXXXX";
+  if (!mkdtemp(dir))
+    return "";
+  std::ofstream(std::string(dir) + "/policy_init.yml") << "Require: {}\n";
+  std::ofstream meta(std::string(dir) + "/policy_meta.yml");
+  meta << "Metadata:\n";
+  for (int i = 0; i < meta_count + group_count; i++)
+    meta << "  - name: " << meta_name(i) << "\n    id: " << i << "\n";
+  std::ofstream group(std::string(dir) + "/policy_group.yml");
+  group << "Groups:\n";
+  int g = 0;
+  for (const std::string& m : mnemonics)
+    group << "  " << m << ": [" << meta_name(meta_count + g++ % group_count) << "]\n";
+  return dir;
+}
+
+static void remove_policy(const std::string& dir) {
+  for (const char* file : {"policy_init.yml", "policy_meta.yml", "policy_group.yml"})
+    std::remove((dir + "/" + file).c_str());
+  rmdir(dir.c_str());
+}
+
+// What gen_tag_info applies to an image: code and data sections, then objects scattered through both
+// with a couple of tags each, which overlap often enough to make a few thousand distinct sets.
+static std::vector<image_range_t> random_ranges(size_t size, std::mt19937& rng) {
+  std::vector<image_range_t> ranges;
+  ranges.push_back(image_range_t{{image_base, image_base + size/2}, {meta_name(0), meta_name(1)}});
+  ranges.push_back(image_range_t{{image_base + size/2, image_base + size}, {meta_name(2)}});
+  for (size_t i = 0; i < size/256; i++) {
+    address_t start = image_base + (rng() % (size/4))*4;
+    address_t end = std::min(start + 4*(1 + rng() % 64), (address_t)(image_base + size));
+    ranges.push_back(image_range_t{{start, end}, {meta_name(3 + rng() % (meta_count - 3)), meta_name(3 + rng() % (meta_count - 3))}});
+  }
+  return ranges;
+}
+
+/**
+ * gen_tag_info's tagging passes over a synthetic image: apply_tags() for the range map, then
+ * tag_opcodes() over the code.  Both canonize a metadata set for every word they touch, so the cost
+ * per word should stay flat as the image and the number of distinct sets grow.  Then looks up the
+ * metadata for each instruction in order, as annotate_asm() does, and numbers the distinct
+ * metadata for the tag file.
+ */
+void tagging_benchmarks(bench_runner_t& runner) {
+  for (size_t size : {1 << 20, 4 << 20, 16 << 20}) {
+    std::string name = std::to_string(size >> 20) + "MiB";
+    if (!runner.enabled("tagging/apply_tags/" + name) && !runner.enabled("tagging/tag_opcodes/" + name) &&
+        !runner.enabled("tagging/lookup/get_metadata/" + name) && !runner.enabled("tagging/lookup/cursor/" + name) &&
+        !runner.enabled("tagging/index_map/" + name) && !runner.enabled("tagging/range_map/add_range/" + name) &&
+        !runner.enabled("tagging/range_map/contains/" + name) && !runner.enabled("tagging/range_map/get_tags/" + name) &&
+        !runner.enabled("tagging/tag_opcodes/parallel/" + name))
+      continue;
+
+    std::mt19937 rng(0x5eed);
+    std::set<std::string> mnemonics;
+    std::vector<uint8_t> text = random_text(size/2, rng, mnemonics);
+    std::vector<image_range_t> ranges = random_ranges(size, rng);
+    std::string policy_dir = write_policy(mnemonics);
+    if (policy_dir.empty()) {
+      runner.fail("tagging: can't write a policy");
+      return;
+    }
+    metadata_factory_t md_factory(policy_dir);
+    remove_policy(policy_dir);
+
+    // gen_tag_info collects the ranges in a range_map_t, and the llvm tagger asks whether each word of
+    // code is inside one of them
+    range_map_t range_map;
+    auto add_ranges = [&](uint64_t) {
+      for (const image_range_t& r : ranges)
+        range_map.add_range(r.range.start, r.range.end, r.tags);
+    };
+    if (!runner.run("tagging/range_map/add_range/" + name, ranges.size(), add_ranges))
+      add_ranges(0);
+    bool contained = true;
+    runner.run("tagging/range_map/contains/" + name, size/8, [&](uint64_t) {
+      for (address_t addr = image_base; addr < image_base + size/2; addr += 4)
+        contained &= range_map.contains(tagged_range_t{{addr, addr + 4}, {}});
+    });
+    if (!range_map.contains(tagged_range_t{{image_base, image_base + size/2}, {}}) || !contained ||
+        range_map.contains(tagged_range_t{{image_base, image_base + size/2 + 4}, {}}))
+      runner.fail("tagging/range_map/" + name + ": wrong containment");
+
+    // the tags of the first range added over each word, checked against a scan of every range
+    runner.run("tagging/range_map/get_tags/" + name, size/4, [&](uint64_t) {
+      for (address_t addr = image_base; addr < image_base + size; addr += 4)
+        keep(range_map.get_tags(addr).size());
+    });
+    for (address_t addr = image_base; addr < image_base + size; addr += size/64 + 4) {
+      auto first = std::find_if(range_map.begin(), range_map.end(), [&](const tagged_range_t& r) { return r.range.contains(addr); });
+      if (range_map.get_tags(addr) != (first == range_map.end() ? std::vector<std::string>() : first->tags)) {
+        runner.fail("tagging/range_map/get_tags/" + name + ": wrong range");
+        break;
+      }
+    }
+
+    // the later benchmarks need the map built even if these are filtered out
+    metadata_memory_map_t map;
+    auto apply_tags = [&](uint64_t) { md_factory.apply_tags(map, ranges); };
+    if (!runner.run("tagging/apply_tags/" + name, size/4, apply_tags))
+      apply_tags(0);
+    runner.counter("distinct", map.distinct_metadata());
+    runner.counter("runs", map.run_count());
+
+    reporter_t err;
+    auto tag_opcodes = [&](uint64_t) { md_factory.tag_opcodes(map, image_base, 32, text.data(), size/2, err); };
+    if (!runner.run("tagging/tag_opcodes/" + name, size/8, tag_opcodes))
+      tag_opcodes(0);
+    runner.counter("distinct", map.distinct_metadata());
+    runner.counter("runs", map.run_count());
+    if (err.warnings > 0)
+      runner.fail("tagging/tag_opcodes/" + name + ": " + std::to_string(err.warnings) + " warnings");
+
+    // gen_tag_info decodes with a thread per core, which has to come out the same
+    unsigned threads = std::max(std::thread::hardware_concurrency(), 2U);
+    metadata_memory_map_t parallel_map;
+    md_factory.apply_tags(parallel_map, ranges);
+    auto tag_opcodes_parallel = [&](uint64_t) { md_factory.tag_opcodes(parallel_map, image_base, 32, text.data(), size/2, err, threads); };
+    if (runner.run("tagging/tag_opcodes/parallel/" + name, size/8, tag_opcodes_parallel))
+      runner.counter("threads", threads);
+    else
+      tag_opcodes_parallel(0);
+    bool same = parallel_map.run_count() == map.run_count() && parallel_map.distinct_metadata() == map.distinct_metadata();
+    for (auto it = map.begin(), parallel_it = parallel_map.begin(); same && it != map.end(); ++it, ++parallel_it)
+      same = it->first == parallel_it->first && *it->second == *parallel_it->second;
+    if (!same || err.warnings > 0)
+      runner.fail("tagging/tag_opcodes/parallel/" + name + ": different from decoding serially");
+
+    // annotate_asm() looks up every instruction address in order
+    runner.run("tagging/lookup/get_metadata/" + name, size/8, [&](uint64_t) {
+      for (address_t addr = image_base; addr < image_base + size/2; addr += 4)
+        keep(map.get_metadata(addr));
+    });
+    runner.run("tagging/lookup/cursor/" + name, size/8, [&](uint64_t) {
+      metadata_memory_map_t::cursor_t cursor = map.cursor();
+      for (address_t addr = image_base; addr < image_base + size/2; addr += 4)
+        keep(cursor.get_metadata(addr));
+    });
+    metadata_memory_map_t::cursor_t cursor = map.cursor();
+    bool agree = true;
+    for (address_t addr = image_base; addr < image_base + size; addr += 4)
+      agree &= cursor.get_metadata(addr) == map.get_metadata(addr);
+    if (!agree)
+      runner.fail("tagging/lookup/" + name + ": cursor and get_metadata() disagree");
+
+    // embed_tags() and write_tag_file() number the distinct metadata in the map
+    metadata_index_map_t<metadata_memory_map_t, range_t> index_map;
+    runner.run("tagging/index_map/" + name, map.run_count(), [&](uint64_t) {
+      index_map = metadata_index_map_t<metadata_memory_map_t, range_t>(map);
+    });
+    std::unordered_set<const metadata_t*> values;
+    bool indexed = true;
+    for (const auto& [ range, md ] : map) {
+      values.insert(md);
+      indexed &= index_map.size() == 0 || *index_map.metadata[index_map.at(range)] == *md;
+    }
+    if (index_map.size() != 0 && (!indexed || index_map.metadata.size() != values.size()))
+      runner.fail("tagging/index_map/" + name + ": wrong indexes");
+
+    // every word gets the union of the tags of the ranges covering it
+    for (int i = 0; i < 256; i++) {
+      address_t addr = image_base + (rng() % (size/4))*4;
+      metadata_t expected;
+      for (const image_range_t& r : ranges) {
+        if (r.range.contains(addr))
+          for (const std::string& tag : r.tags)
+            expected.insert(md_factory.lookup_metadata(tag));
+      }
+      const metadata_t* md = map.get_metadata(addr);
+      bool ok = md != nullptr;
+      for (meta_t m : expected)
+        ok &= md && std::binary_search(md->begin(), md->end(), m);
+      if (!ok) {
+        char buf[128];
+        std::snprintf(buf, sizeof(buf), "tagging/%s: wrong metadata at %#lx", name.c_str(), addr);
+        runner.fail(buf);
+        break;
+      }
+    }
+  }
+}
+
+} // namespace policy_engine
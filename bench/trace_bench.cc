@@ -0,0 +1,90 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include <string>
+#include <vector>
+#include <unistd.h>
+#include "bench.h"
+#include "trace_file.h"
+
+namespace policy_engine {
+
+/**
+ * Writes a trace the way a simulator would, a record per retired instruction, and reads it back in
+ * the blocks rv_trace_replay uses, checking that every record comes back as it was written.
+ */
+void trace_benchmarks(bench_runner_t& runner) {
+  if (!runner.enabled("trace/write") && !runner.enabled("trace/read"))
+    return;
+  char path[] = "/tmp/policy_engine_bench.XXXXXX";
+  int fd = mkstemp(path);
+  if (fd < 0) {
+    runner.fail("trace: can't create a trace file");
+    return;
+  }
+  close(fd);
+
+  static const size_t count = 1 << 20;
+  std::mt19937_64 rng(0x5eed);
+  std::vector<trace_entry_t> written(count);
+  for (size_t i = 0; i < count; i++)
+    written[i] = trace_entry_t{0x80000000 + 4*i, i & 3 ? 0 : 0x80100000 + (rng() & 0xffff), rng(), (uint32_t)rng(), 0};
+
+  try {
+    auto write = [&](uint64_t) {
+      trace_writer_t trace(path);
+      for (const trace_entry_t& entry : written)
+        trace.write(entry);
+    };
+    if (!runner.run("trace/write", count, write))
+      write(0);
+
+    std::vector<trace_entry_t> read;
+    runner.run("trace/read", count, [&](uint64_t) {
+      trace_reader_t trace(path);
+      std::vector<trace_entry_t> entries(1 << 16);
+      read.clear();
+      while (size_t n = trace.read(entries))
+        read.insert(read.end(), entries.begin(), entries.begin() + n);
+    });
+    if (runner.enabled("trace/read")) {
+      bool same = read.size() == written.size();
+      for (size_t i = 0; same && i < count; i++)
+        same = read[i].pc == written[i].pc && read[i].mem_addr == written[i].mem_addr && read[i].rs1 == written[i].rs1 && read[i].insn == written[i].insn;
+      if (!same)
+        runner.fail("trace/read: records don't match what was written");
+    }
+  } catch (const std::exception& e) {
+    runner.fail(std::string("trace: ") + e.what());
+  }
+  std::remove(path);
+}
+
+} // namespace policy_engine
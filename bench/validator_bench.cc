@@ -0,0 +1,119 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include <cstdint>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <yaml-cpp/yaml.h>
+#include "bench.h"
+#include "policy_eval.h"
+#include "rv_validator.h"
+#include "validator_exception.h"
+
+static std::unique_ptr<policy_engine::rv_validator_t> rv_validator;
+static uint64_t data_addr;
+
+static uint64_t bench_reg_reader(uint32_t) { return data_addr; }
+static uint64_t bench_addr_fixer(uint64_t addr) { return addr; }
+
+namespace policy_engine {
+
+// Stands in for the generated policy so the timing covers only the validator's own work: every
+// instruction is allowed and keeps the default results setup_validation() gave it.
+static int allow_everything(context_t*, const operands_t*, results_t*) {
+  return POLICY_SUCCESS;
+}
+
+// Where the loop below runs: the largest heterogeneous region of the SOC configuration.
+static address_t find_ram(const std::string& soc_cfg) {
+  address_t start = 0, size = 0;
+  YAML::Node n = YAML::LoadFile(soc_cfg);
+  for (const auto& it : n["SOC"]) {
+    const YAML::Node& e = it.second;
+    address_t s = e["start"].as<address_t>(), end = e["end"].as<address_t>();
+    if (e["heterogeneous"] && e["heterogeneous"].as<bool>() && end - s > size) {
+      start = s;
+      size = end - s;
+    }
+  }
+  if (size < 0x1000)
+    throw configuration_exception_t("no heterogeneous region large enough for the benchmark loop");
+  return start;
+}
+
+// A load/store loop: addi x1,x1,1; lw x2,0(x10); add x3,x1,x2; sw x3,4(x10); j -16
+static const insn_bits_t loop[] = {0x00108093, 0x00052103, 0x002081b3, 0x00352223, 0xff1ff06f};
+static const size_t loop_length = sizeof(loop)/sizeof(loop[0]);
+
+static void cycle_benchmark(bench_runner_t& runner, const std::string& name, address_t code) {
+  rv_validator->rule_cache_hits = 0;
+  rv_validator->rule_cache_misses = 0;
+  bool ok = true;
+  runner.run("validator/validate_commit/" + name, 1 << 20, [&](uint64_t n) {
+    for (uint64_t i = 0; i < n; i++) {
+      size_t k = i % loop_length;
+      ok &= rv_validator->validate(code + 4*k, loop[k]);
+      rv_validator->commit();
+    }
+  });
+  if (rv_validator->rule_cache) {
+    uint64_t total = rv_validator->rule_cache_hits + rv_validator->rule_cache_misses;
+    runner.counter("hit_rate", total ? (double)rv_validator->rule_cache_hits/total : 0);
+  }
+  if (!ok)
+    runner.fail("validator/validate_commit/" + name + " reported a violation from a policy that allows everything");
+}
+
+/**
+ * The whole validate and commit cycle of the simulator library, with the policy stubbed out.  This
+ * needs a policy directory for the meta set names the validator looks up when it starts, so it's
+ * skipped if there isn't one.
+ */
+void validator_benchmarks(bench_runner_t& runner, const bench_options_t& options) {
+  if (options.policy_dir.empty())
+    return;
+  if (!runner.enabled("validator/validate_commit/no_rule_cache") && !runner.enabled("validator/validate_commit/ideal"))
+    return;
+
+  address_t code;
+  try {
+    code = find_ram(options.soc_cfg);
+    rv_validator = std::make_unique<rv_validator_t>(32, options.policy_dir, options.soc_cfg, bench_reg_reader, bench_addr_fixer);
+    rv_validator->policy_evaluator = allow_everything;
+  } catch (const std::exception& e) {
+    std::fprintf(stderr, "validator: can't set up: %s\n", e.what());
+    return;
+  }
+  data_addr = code + 0x800;
+
+  cycle_benchmark(runner, "no_rule_cache", code);
+  rv_validator->rule_cache = new ideal_rule_cache_t();
+  cycle_benchmark(runner, "ideal", code);
+  rv_validator.reset();
+}
+
+} // namespace policy_engine
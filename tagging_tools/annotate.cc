@@ -29,6 +29,7 @@
 #include <memory>
 #include <stdexcept>
 #include <string>
+#include <unordered_map>
 #include "metadata.h"
 #include "metadata_memory_map.h"
 #include "metadata_factory.h"
@@ -61,24 +62,31 @@ void annotate_asm(metadata_factory_t& md_factory, metadata_memory_map_t& md_map,
   if (!asm_out)
     throw std::ios::failure("couldn't open output file " + fname);
 
+  // objdump lists addresses in increasing order within each section, and many share metadata
+  metadata_memory_map_t::cursor_t cursor = md_map.cursor();
+  std::unordered_map<const metadata_t*, std::string> rendered;
   for (std::string line; std::getline(asm_in, line);) {
     bool stop = false;
     for (std::size_t i = 0; i < line.size() && !stop; i++) {
       if (!isspace(line[i]) && !isxdigit(line[i])) {
         stop = true;
         if (i > 0 && line[i] == ':' && !isspace(line[i - 1])) {
-          if (const metadata_t* metadata = md_map.get_metadata(std::stoul(line.substr(0, i), nullptr, 16)))
-            asm_out << pad(line, 80) + md_factory.render(metadata, true) << std::endl;
-          else
-            asm_out << line << std::endl;
+          if (const metadata_t* metadata = cursor.get_metadata(std::stoul(line.substr(0, i), nullptr, 16))) {
+            auto it = rendered.find(metadata);
+            if (it == rendered.end())
+              it = rendered.emplace(metadata, md_factory.render(metadata, true)).first;
+            asm_out << pad(line, 80) << it->second << '\n';
+          } else {
+            asm_out << line << '\n';
+          }
         } else {
-          asm_out << line << std::endl;
+          asm_out << line << '\n';
         }
       }
     }
     // edge case - entire line was nothing but numbers (can this happen?), or empty (just a newline)
     if (!stop) {
-      asm_out << line << std::endl;
+      asm_out << line << '\n';
     }
   }
 }
@@ -117,4 +117,13 @@ elf_image_t::~elf_image_t() {
     close(fd);
 }
 
+std::vector<range_t> elf_image_t::code_ranges() const {
+  std::vector<range_t> ranges;
+  for (const elf_section_t& section : sections) {
+    if ((section.flags & (SHF_ALLOC | SHF_EXECINSTR)) == (SHF_ALLOC | SHF_EXECINSTR))
+      ranges.push_back(range_t{section.address, section.end_address()});
+  }
+  return ranges;
+}
+
 } // namespace policy_engine
\ No newline at end of file
@@ -70,6 +70,9 @@ public:
 
   int word_bytes() const { return ehdr.e_ident[4] == ELFCLASS64 ? 8 : 4; }
   uintptr_t entry_point() const { return ehdr.e_entry; }
+
+  // address ranges of the sections that are loaded and executable
+  std::vector<range_t> code_ranges() const;
 };
 
 } // namespace policy_engine
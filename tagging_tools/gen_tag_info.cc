@@ -8,6 +8,7 @@
 #include <memory>
 #include <string>
 #include <sys/stat.h>
+#include <thread>
 #include <unistd.h>
 #include <yaml-cpp/yaml.h>
 #include "annotate.h"
@@ -35,6 +36,7 @@ DEFINE_string(bin, "", "Program binary to parse for tags");
 DEFINE_string(log, "WARNING", "Logging level (DEBUG, WARNING, INFO)");
 DEFINE_bool(entities, false, "Entities file for policy");
 DEFINE_string(soc_file, "", "SOC config file. If present, write TMT headers for PEX firmware");
+DEFINE_int32(threads, 0, "Threads to decode instructions with (0 for one per core)");
 
 int main(int argc, char* argv[]) {
   policy_engine::reporter_t err;
@@ -98,9 +100,10 @@ int main(int argc, char* argv[]) {
   // have to reopen the file here because it's been edited and the current copy is corrupt
   policy_engine::elf_image_t elf_image_post(FLAGS_bin);
 
+  unsigned threads = FLAGS_threads > 0 ? FLAGS_threads : std::thread::hardware_concurrency();
   for (const policy_engine::elf_section_t& section : elf_image_post.sections)
     if (section.flags & SHF_EXECINSTR)
-      md_factory.tag_opcodes(md_memory_map, section.address, elf_image_post.word_bytes()*8, section.data, section.size, err);
+      md_factory.tag_opcodes(md_memory_map, section.address, elf_image_post.word_bytes()*8, section.data, section.size, err, threads);
 
   std::vector<std::string> entities{FLAGS_policy_dir + "/policy_entities.yml"};
   for (int i = 1; i < argc; i++)
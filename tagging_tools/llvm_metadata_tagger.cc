@@ -19,16 +19,16 @@ uint64_t round_up(uint64_t x, uint64_t align) {
 }
 
 const std::map<std::string, uint8_t> llvm_metadata_tagger_t::metadata_ops = {
-  {"DMD_SET_BASE_ADDRESS_OP", 0x1},
-  {"DMD_TAG_ADDRESS_OP", 0x2},
-  {"DMD_TAG_ADDRESS_RANGE_OP", 0x3},
-  {"DMD_TAG_POLICY_SYMBOL", 0x4},
-  {"DMD_TAG_POLICY_RANGE", 0x5},
-  {"DMD_TAG_POLICY_SYMBOL_RANKED", 0x6},
-  {"DMD_TAG_POLICY_RANGE_RANKED", 0x7},
-  {"DMD_END_BLOCK", 0x8},
-  {"DMD_END_BLOCK_WEAK_DECL_HACK", 0x9},
-  {"DMD_FUNCTION_RANGE", 0xa}
+  {"DMD_SET_BASE_ADDRESS_OP", DMD_SET_BASE_ADDRESS_OP},
+  {"DMD_TAG_ADDRESS_OP", DMD_TAG_ADDRESS_OP},
+  {"DMD_TAG_ADDRESS_RANGE_OP", DMD_TAG_ADDRESS_RANGE_OP},
+  {"DMD_TAG_POLICY_SYMBOL", DMD_TAG_POLICY_SYMBOL},
+  {"DMD_TAG_POLICY_RANGE", DMD_TAG_POLICY_RANGE},
+  {"DMD_TAG_POLICY_SYMBOL_RANKED", DMD_TAG_POLICY_SYMBOL_RANKED},
+  {"DMD_TAG_POLICY_RANGE_RANKED", DMD_TAG_POLICY_RANGE_RANKED},
+  {"DMD_END_BLOCK", DMD_END_BLOCK},
+  {"DMD_END_BLOCK_WEAK_DECL_HACK", DMD_END_BLOCK_WEAK_DECL_HACK},
+  {"DMD_FUNCTION_RANGE", DMD_FUNCTION_RANGE}
 };
 
 const std::map<std::string, uint8_t> llvm_metadata_tagger_t::tag_specifiers = {
@@ -119,15 +119,16 @@ void llvm_metadata_tagger_t::add_code_section_ranges(const elf_image_t& ef, rang
   }
 }
 
-void llvm_metadata_tagger_t::check_and_add_range(range_map_t& range_map, uint64_t start, uint64_t end, uint8_t tag_specifier, const YAML::Node& policy_inits) {
+// Names of the tags the policy needs, indexed by the tag specifier byte that marks them in the metadata
+std::array<std::vector<std::string>, 256> llvm_metadata_tagger_t::needed_tags(const YAML::Node& policy_inits) {
+  std::array<std::vector<std::string>, 256> needed;
   for (const auto& [ policy, tags ] : policy_map) {
     if (policy_needs_tag(policy_inits["Require"], tags.at("name"))) {
-      if (tag_specifiers.at(tags.at("tag_specifier")) == tag_specifier) {
-        err.info("saw tag %s = %#lx:%#lx\n", tags.at("name").c_str(), start, end);
-        range_map.add_range(start, end, tags.at("name"));
-      }
+      err.info("tagging %s\n", tags.at("name"));
+      needed[tag_specifiers.at(tags.at("tag_specifier"))].push_back(tags.at("name"));
     }
   }
+  return needed;
 }
 
 static const std::string COMPILER_GENERATED = "COMPILER_GENERATED";
@@ -136,75 +137,93 @@ range_map_t llvm_metadata_tagger_t::generate_policy_ranges(const elf_image_t& ef
   auto metadata_section = std::find_if(ef.sections.begin(), ef.sections.end(), [](const elf_section_t& s){ return s.name == ".dover_metadata"; });
   if (metadata_section == ef.sections.end())
     throw std::runtime_error("no metadata found in ELF file");
-  uint8_t* metadata = reinterpret_cast<uint8_t*>(metadata_section->data);
-  if (metadata[0] != metadata_ops.at("DMD_SET_BASE_ADDRESS_OP"))
+  const uint8_t* metadata = reinterpret_cast<const uint8_t*>(metadata_section->data);
+  const uint64_t size = metadata_section->size;
+  if (size == 0 || metadata[0] != DMD_SET_BASE_ADDRESS_OP)
     throw std::runtime_error("invalid metadata found in ELF file");
-  
+
+  const std::array<std::vector<std::string>, 256> needed = needed_tags(policy_inits);
   range_map_t range_map, compiler_generated_map;
   uint64_t base_address = 0;
-  for (int i = 0; i < metadata_section->size;) {
-    // Don't increment i at the end of the loop because it should point to the next op after the if block
+  uint64_t tagged = 0, blocks = 0, functions = 0;
+  uint64_t i = 0;
+
+  // little-endian fields of each record, checked against the end of the section
+  auto read = [&](int bytes) {
+    if (i + bytes > size)
+      throw std::runtime_error("truncated metadata in ELF file");
+    uint64_t value = 0;
+    for (int j = 0; j < bytes; j++)
+      value |= static_cast<uint64_t>(metadata[i++]) << (j*8);
+    return value;
+  };
+  auto tag = [&](uint64_t start, uint64_t end) {
+    for (const std::string& name : needed[read(1)])
+      range_map.add_range(start, end, name);
+    tagged++;
+  };
+
+  while (i < size) {
     uint8_t op = metadata[i++];
-    if (op == metadata_ops.at("DMD_SET_BASE_ADDRESS_OP")) {
-      base_address = 0;
-      for (int j = 0; j < 8; j++, i++)
-        base_address += static_cast<uint64_t>(metadata[i]) << (j*8);
-      err.info("new base address is %#x\n", base_address);
-    } else if (op == metadata_ops.at("DMD_TAG_ADDRESS_OP")) {
-      uint64_t address = base_address;
-      for (int j = 0; j < PTR_SIZE; j++, i++)
-        address += static_cast<uint64_t>(metadata[i]) << (j*8);
-      uint8_t tag_specifier = metadata[i++];
-      err.info("tag is %#x at address %#lx\n", tag_specifier, address);
-      check_and_add_range(range_map, address, address + PTR_SIZE, tag_specifier, policy_inits);
-    } else if (op == metadata_ops.at("DMD_TAG_ADDRESS_OP")) {
-      uint64_t start_address = base_address, end_address = base_address;
-      for (int j = 0; j < PTR_SIZE; j++, i++)
-        start_address += static_cast<uint64_t>(metadata[i]) << (j*8);
-      for (int j = 0; j < PTR_SIZE; j++, i++)
-        end_address += static_cast<uint64_t>(metadata[i]) << (j*8);
-      uint8_t tag_specifier = metadata[i++];
-      err.info("tag is %#x for address range %#lx:%#lx\n", tag_specifier, start_address, end_address);
-      check_and_add_range(range_map, start_address, end_address, tag_specifier, policy_inits);
-    } else if (op == metadata_ops.at("DMD_END_BLOCK")) {
-      uint64_t end_address = 0;
-      for (int j = 0; j < PTR_SIZE; j++, i++)
-        end_address += static_cast<uint64_t>(metadata[i]) << (j*8);
-      err.info("saw end block tag range = %#lx:%#lx\n", base_address, base_address + end_address);
-      compiler_generated_map.add_range(base_address, base_address + end_address, COMPILER_GENERATED);
-    } else if (op == metadata_ops.at("DMD_FUNCTION_RANGE")) {
-      uint64_t start_address = base_address, end_address = base_address;
-      for (int j = 0; j < PTR_SIZE; j++, i++)
-        start_address += static_cast<uint64_t>(metadata[i]) << (j*8);
-      for (int j = 0; j < PTR_SIZE; j++, i++)
-        end_address += static_cast<uint64_t>(metadata[i]) << (j*8);
-      err.info("saw function range = %#lx:%#lx\n", start_address, end_address);
-      compiler_generated_map.add_range(start_address, end_address, COMPILER_GENERATED);
-    } else if (op == metadata_ops.at("DMD_TAG_POLICY_SYMBOL")) {
-      throw std::runtime_error("saw policy symbol");
-    } else if (op == metadata_ops.at("DMD_TAG_POLICY_RANGE")) {
-      throw std::runtime_error("saw policy range");
-    } else if (op == metadata_ops.at("DMD_TAG_POLICY_SYMBOL_RANKED")) {
-      throw std::runtime_error("saw policy symbol ranked");
-    } else if (op == metadata_ops.at("DMD_TAG_POLICY_RANGE_RANKED")) {
-      throw std::runtime_error("saw policy range ranked");
-    } else if (op == metadata_ops.at("DMD_END_BLOCK_WEAK_DECL_HACK")) {
-      throw std::runtime_error("saw end weak decl tag");
-    } else {
-      throw std::runtime_error("found unknown byte in metadata: " + std::to_string(metadata[i]));
+    switch (op) {
+      case DMD_SET_BASE_ADDRESS_OP:
+        base_address = read(8);
+        err.info("new base address is %#lx\n", base_address);
+        break;
+      case DMD_TAG_ADDRESS_OP: {
+        uint64_t address = base_address + read(PTR_SIZE);
+        tag(address, address + PTR_SIZE);
+        break;
+      }
+      case DMD_TAG_ADDRESS_RANGE_OP: {
+        uint64_t start_address = base_address + read(PTR_SIZE);
+        uint64_t end_address = base_address + read(PTR_SIZE);
+        tag(start_address, end_address);
+        break;
+      }
+      case DMD_END_BLOCK:
+        compiler_generated_map.add_range(base_address, base_address + read(PTR_SIZE), COMPILER_GENERATED);
+        blocks++;
+        break;
+      case DMD_FUNCTION_RANGE: {
+        uint64_t start_address = base_address + read(PTR_SIZE);
+        uint64_t end_address = base_address + read(PTR_SIZE);
+        compiler_generated_map.add_range(start_address, end_address, COMPILER_GENERATED);
+        functions++;
+        break;
+      }
+      case DMD_TAG_POLICY_SYMBOL:
+        throw std::runtime_error("saw policy symbol");
+      case DMD_TAG_POLICY_RANGE:
+        throw std::runtime_error("saw policy range");
+      case DMD_TAG_POLICY_SYMBOL_RANKED:
+        throw std::runtime_error("saw policy symbol ranked");
+      case DMD_TAG_POLICY_RANGE_RANKED:
+        throw std::runtime_error("saw policy range ranked");
+      case DMD_END_BLOCK_WEAK_DECL_HACK:
+        throw std::runtime_error("saw end weak decl tag");
+      default:
+        throw std::runtime_error("found unknown byte in metadata: " + std::to_string(op));
     }
   }
+  err.info("saw %lu tags, %lu end blocks and %lu function ranges\n", tagged, blocks, functions);
 
+  // Tag the words of code that no other range covers as NoCFI.  This sweeps each code range in order, skipping
+  // over covered words and tagging each uncovered run of words up to the next range that could cover them at once.
   if (policy_inits["Require"]["llvm"]["NoCFI"]) {
     range_map_t code_range_map;
     add_code_section_ranges(ef, code_range_map);
-    for (auto& [ range, tags ] : code_range_map) {
-      for (uint64_t s = range.start; s < range.end; s += PTR_SIZE) {
-        uint64_t e = s + PTR_SIZE;
-        tagged_range_t r{{s, e}, tags};
-        if (!range_map.contains(r) && !compiler_generated_map.contains(r)) {
+    for (const auto& [ range, tags ] : code_range_map) {
+      for (uint64_t s = range.start; s < range.end;) {
+        uint64_t covered = std::max(range_map.covered_to(s), compiler_generated_map.covered_to(s));
+        if (covered >= s + PTR_SIZE) {
+          s += ((covered - s)/PTR_SIZE)*PTR_SIZE;
+        } else {
+          uint64_t next = std::min({range_map.next_start(s), compiler_generated_map.next_start(s), range.end});
+          uint64_t e = s + round_up(next - s, PTR_SIZE);
           err.info("llvm.NoCFI range = %lx:%lx\n", s, e);
           range_map.add_range(s, e, "llvm.NoCFI");
+          s = e;
         }
       }
     }
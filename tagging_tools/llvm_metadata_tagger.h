@@ -1,9 +1,11 @@
 #ifndef __LLVM_METADATA_TAGGER_H__
 #define __LLVM_METADATA_TAGGER_H__
 
+#include <array>
 #include <cstdint>
 #include <map>
 #include <string>
+#include <vector>
 #include <yaml-cpp/yaml.h>
 #include "elf_loader.h"
 #include "range_map.h"
@@ -17,6 +19,20 @@ private:
   reporter_t& err;
 public:
   static constexpr int PTR_SIZE = 4;
+
+  enum metadata_op_t : uint8_t {
+    DMD_SET_BASE_ADDRESS_OP = 0x1,
+    DMD_TAG_ADDRESS_OP = 0x2,
+    DMD_TAG_ADDRESS_RANGE_OP = 0x3,
+    DMD_TAG_POLICY_SYMBOL = 0x4,
+    DMD_TAG_POLICY_RANGE = 0x5,
+    DMD_TAG_POLICY_SYMBOL_RANKED = 0x6,
+    DMD_TAG_POLICY_RANGE_RANKED = 0x7,
+    DMD_END_BLOCK = 0x8,
+    DMD_END_BLOCK_WEAK_DECL_HACK = 0x9,
+    DMD_FUNCTION_RANGE = 0xa
+  };
+
   static const std::map<std::string, uint8_t> metadata_ops;
   static const std::map<std::string, uint8_t> tag_specifiers;
   static const std::map<std::string, std::map<std::string, std::string>> policy_map;
@@ -25,7 +41,7 @@ public:
 
   bool policy_needs_tag(const YAML::Node& policy_inits, const std::string& tag);
   void add_code_section_ranges(const elf_image_t& ef, range_map_t& range_map);
-  void check_and_add_range(range_map_t& range_map, uint64_t start, uint64_t end, uint8_t tag_specifier, const YAML::Node& policy_inits);
+  std::array<std::vector<std::string>, 256> needed_tags(const YAML::Node& policy_inits);
   range_map_t generate_policy_ranges(const elf_image_t& ef, const YAML::Node& policy_inits);
 };
 
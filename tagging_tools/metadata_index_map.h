@@ -6,6 +6,7 @@
 #include <iterator>
 #include <map>
 #include <memory>
+#include <unordered_map>
 #include <utility>
 #include <vector>
 #include "metadata_memory_map.h"
@@ -28,6 +29,18 @@ class metadata_index_map_t : private std::map<K, int> {
 private:
   using parent = typename std::map<K, int>;
 
+  // index of each value in metadata, by contents
+  std::unordered_map<const metadata_t*, int, metadata_ptr_hash_t, metadata_ptr_equal_t> indexes;
+
+  void index(const M& metadata_map) {
+    for (const auto& [ key, value ] : metadata_map) {
+      const auto [ it, added ] = indexes.emplace(value, metadata.size());
+      if (added)
+        metadata.push_back(value);
+      (*this)[key] = it->second;
+    }
+  }
+
 public:
   using iterator = typename parent::iterator;
   using const_iterator = typename parent::const_iterator;
@@ -37,25 +50,14 @@ public:
 
   metadata_index_map_t() {}
 
-  metadata_index_map_t(const M& metadata_map, std::vector<const metadata_t*> initial_metadata) {
-    metadata = std::vector(initial_metadata);
-    for (const auto& [ key, value ] : metadata_map) {
-      const auto it = std::find_if(metadata.begin(), metadata.end(), [&value](const metadata_t* v){ return *v == *value; });
-      (*this)[key] = std::distance(metadata.begin(), it);
-      if (it == metadata.end()) {
-        metadata.push_back(value);
-      }
-    }
+  // metadata starts as initial_metadata, followed by any values in metadata_map it doesn't have
+  metadata_index_map_t(const M& metadata_map, std::vector<const metadata_t*> initial_metadata) : metadata(std::move(initial_metadata)) {
+    for (std::size_t i = 0; i < metadata.size(); i++)
+      indexes.emplace(metadata[i], i);
+    index(metadata_map);
   }
 
-  metadata_index_map_t(const M& metadata_map) {
-    for (const auto& [ key, value ] : metadata_map) {
-      const auto it = std::find_if(metadata.begin(), metadata.end(), [&value](const metadata_t* v){ return *v == *value; });
-      (*this)[key] = std::distance(metadata.begin(), it);
-      if (it == metadata.end())
-        metadata.push_back(value);
-    }
-  }
+  metadata_index_map_t(const M& metadata_map) { index(metadata_map); }
 
   using parent::begin;
   using parent::end;
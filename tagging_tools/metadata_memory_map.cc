@@ -24,62 +24,109 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
-#include <algorithm>
 #include <cstdint>
-#include <string>
+#include <iterator>
 #include "metadata_memory_map.h"
 #include "range.h"
-#include <iostream>
-namespace policy_engine {
-  
-void metadata_memory_map_t::mem_region_t::add_range(uint64_t start, uint64_t end, const metadata_t& metadata) {
-  if (range.start == range.end) {
-    range.start = start;
-    assert(mem.size() == 0); // first range added
-  } else if (start < range.start) {
-    // inserting before the existing base - have to insert a bit
-    int n_insert = (range.start - start)/stride;
-    mem.insert(mem.begin(), n_insert, nullptr);
-    range.start = start;
-  }
 
-  int s = (start - range.start)/stride;
-  int e = (end - range.start)/stride;
+namespace policy_engine {
 
-  if (e > mem.size()) {
-    mem.resize(e, nullptr);
-    range.end = index_to_addr(e);
+// the run containing addr, or the first one after it; checks around the last run added to first,
+// since ranges tend to be added in address order
+std::map<uint64_t, metadata_memory_map_t::run_t>::iterator metadata_memory_map_t::find_run(uint64_t addr) {
+  if (last != runs.end() && last->first <= addr) {
+    if (addr < last->second.end)
+      return last;
+    auto next = std::next(last);
+    if (next == runs.end() || addr < next->second.end)
+      return next;
   }
+  auto it = runs.upper_bound(addr);
+  if (it != runs.begin() && addr < std::prev(it)->second.end)
+    return std::prev(it);
+  return it;
+}
 
-  while (s < e) {
-    metadata_t md(metadata);
-    if (mem[s])
-      md.insert(mem[s]);
-    mem[s++] = &map->md_cache.canonize(md);
+// joins the run at it with the one after it if they touch and have the same metadata
+bool metadata_memory_map_t::merge(std::map<uint64_t, run_t>::iterator it) {
+  auto next = std::next(it);
+  if (next == runs.end() || it->second.end != next->first || it->second.metadata != next->second.metadata)
+    return false;
+  it->second.end = next->second.end;
+  runs.erase(next);
+  return true;
+}
+
+const metadata_t* metadata_memory_map_t::union_of(const metadata_t* existing, const metadata_t* added) {
+  const metadata_t*& u = unions[std::make_pair(existing, added)];
+  if (!u) {
+    metadata_t md(*added);
+    md.insert(existing);
+    u = &md_cache.canonize(md);
   }
+  return u;
 }
 
 void metadata_memory_map_t::add_range(uint64_t start, uint64_t end, const metadata_t& metadata) {
+  start -= start % stride;
+  end -= end % stride;
   /* this is a meaningless call */
   if (start >= end)
     return;
 
-  if (auto it = std::find_if(mrs.begin(), mrs.end(), [&](const mem_region_t& r){ return r.adjacent(start) || r.adjacent(end); }); it != mrs.end()) {
-    it->add_range(start, end, metadata);
-  } else {
-    /* an appropriate existing MR was not found - make a new one */
-    mem_region_t mr(*this);
-    mr.add_range(start, end, metadata);
-    mrs.insert(std::find_if(mrs.begin(), mrs.end(), [&](const mem_region_t& r){ return end < r.range.start; }), mr); // will add at end if not found
+  const metadata_t* added = &md_cache.canonize(metadata);
+  auto it = find_run(start);
+  if (it != runs.end() && it->first < start) {
+    it = runs.emplace_hint(std::next(it), start, run_t{it->second.end, it->second.metadata});
+    std::prev(it)->second.end = start;
   }
+
+  // union into the runs in [start, end), filling in the gaps between them with just the new metadata
+  auto first = runs.end();
+  for (uint64_t addr = start; addr < end;) {
+    if (it == runs.end() || it->first > addr) {
+      uint64_t gap_end = (it == runs.end() || it->first > end) ? end : it->first;
+      auto gap = runs.emplace_hint(it, addr, run_t{gap_end, added});
+      if (first == runs.end())
+        first = gap;
+      addr = gap_end;
+    } else {
+      if (it->second.end > end) {
+        runs.emplace_hint(std::next(it), end, run_t{it->second.end, it->second.metadata});
+        it->second.end = end;
+      }
+      it->second.metadata = union_of(it->second.metadata, added);
+      if (first == runs.end())
+        first = it;
+      addr = it->second.end;
+      ++it;
+    }
+  }
+
+  // coalesce runs that now have the same metadata, from the one before start to the one at end
+  it = first == runs.begin() ? first : std::prev(first);
+  for (;;) {
+    while (merge(it))
+      ;
+    auto next = std::next(it);
+    if (next == runs.end() || next->first >= end)
+      break;
+    it = next;
+  }
+  last = it;
+}
+
+// the run containing addr, or the first one after it
+std::map<uint64_t, metadata_memory_map_t::run_t>::const_iterator metadata_memory_map_t::run_at(uint64_t addr) const {
+  auto it = runs.upper_bound(addr);
+  if (it != runs.begin() && addr < std::prev(it)->second.end)
+    return std::prev(it);
+  return it;
 }
 
 const metadata_t* metadata_memory_map_t::get_metadata(uint64_t addr) const {
-  for (const auto& mr : mrs) {
-    if (mr.contains(addr))
-      return mr.getaddr(addr);
-  }
-  return nullptr;
+  auto it = run_at(addr);
+  return it != runs.end() && it->first <= addr ? it->second.metadata : nullptr;
 }
 
-}
\ No newline at end of file
+} // namespace policy_engine
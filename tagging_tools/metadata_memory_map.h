@@ -27,63 +27,62 @@
 #ifndef METADATA_MEMORY_MAP_H
 #define METADATA_MEMORY_MAP_H
 
+#include <cstddef>
 #include <cstdint>
+#include <functional>
+#include <iterator>
+#include <map>
 #include <memory>
-#include <vector>
+#include <unordered_map>
+#include <utility>
 #include "metadata.h"
 #include "metadata_cache.h"
 #include "range.h"
 
 namespace policy_engine {
 
+/**
+ * Metadata for each word of memory, kept as maximal runs of words that have the same canonized
+ * metadata.  Adding a range of metadata splits the runs at its ends and unions the metadata into
+ * each run in between, so its cost depends on the number of runs it covers rather than the number
+ * of words.
+ */
 class metadata_memory_map_t {
 private:
-  class mem_region_t {
-    friend class metadata_memory_map_t;
-
-  private:
-    range_t range;
-    std::vector<metadata_t*> mem;
-    metadata_memory_map_t* map; // must be a raw pointer so it doesn't get cleaned up when mem_region_t does
+  struct run_t {
+    uint64_t end;
+    const metadata_t* metadata;
+  };
 
-  public:
-    /* expose iterator of inner vector */
-    using iterator = typename decltype(mem)::iterator;
-    using const_iterator = typename decltype(mem)::const_iterator;
-
-    static constexpr int stride = sizeof(uint32_t); // platform word size
-
-    mem_region_t(metadata_memory_map_t& m) : range({0, 0}), map(&m) {}
-    
-    iterator begin() { return mem.begin(); }
-    iterator end() { return mem.end(); }
-    const_iterator begin() const noexcept { return mem.cbegin(); }
-    const_iterator end() const noexcept { return mem.cend(); }
-    const_iterator cbegin() const noexcept { return mem.cbegin(); }
-    const_iterator cend() const noexcept { return mem.cend(); }
-
-    constexpr uint64_t index_to_addr(size_t idx) const { return range.start + (idx*stride); }
-    uint64_t itr_to_addr(iterator itr) const { return index_to_addr(itr - begin()); }
-    uint64_t itr_to_addr(const_iterator itr) const { return index_to_addr(itr - cbegin()); }
-    size_t addr_to_index(uint64_t addr) const { return (addr - range.start)/stride; }
-    const metadata_t* getaddr(uint64_t addr) const { return mem.at(addr_to_index(addr)); }
-    bool contains(uint64_t addr) const { return range.contains(addr); }
-    bool adjacent(uint64_t addr) const { return addr >= range.start - stride && addr < range.end + stride; }
-    size_t size() const { return mem.size(); }
-    
-    void add_range(uint64_t start, uint64_t end, const metadata_t& metadata);
+  struct metadata_pair_hash_t {
+    size_t operator ()(const std::pair<const metadata_t*, const metadata_t*>& p) const {
+      return std::hash<const metadata_t*>()(p.first)*31 + std::hash<const metadata_t*>()(p.second);
+    }
   };
 
-  uint64_t base;
-  uint64_t end_address;
+  std::map<uint64_t, run_t> runs; // keyed by start address
+  std::map<uint64_t, run_t>::iterator last; // run containing the end of the last range added
   metadata_cache_t md_cache;
-  std::vector<mem_region_t> mrs;
+  // canonized union of (existing, added) metadata, since the same pairs come up over and over
+  std::unordered_map<std::pair<const metadata_t*, const metadata_t*>, const metadata_t*, metadata_pair_hash_t> unions;
+
+  std::map<uint64_t, run_t>::iterator find_run(uint64_t addr);
+  std::map<uint64_t, run_t>::const_iterator run_at(uint64_t addr) const;
+  bool merge(std::map<uint64_t, run_t>::iterator it);
+  const metadata_t* union_of(const metadata_t* existing, const metadata_t* added);
 
 public:
-  metadata_memory_map_t() : base(-1) {}
+  static constexpr int stride = sizeof(uint32_t); // platform word size
+
+  metadata_memory_map_t() : last(runs.end()) {}
+  // runs point into md_cache, so a copy would have to rebuild them
+  metadata_memory_map_t(const metadata_memory_map_t&) = delete;
+  metadata_memory_map_t& operator =(const metadata_memory_map_t&) = delete;
 
-  template <class MMap, class MRIterator, class MRVIterator>
+  template <class MMap, class RunIterator>
   class ForwardIterator {
+    template<class, class> friend class ForwardIterator;
+
   private:
     using result_type_t = std::pair<range_t, const metadata_t*>;
 
@@ -96,85 +95,44 @@ public:
 
   private:
     MMap* map;
-    MRIterator mr_it;
-    MRVIterator it;
+    RunIterator it;
     result_type_t current;
 
-    void advance() {
-      /* don't advance if done */
-      if (it == map->mrs.end()) {
-        mr_it = mem_region_t::iterator(nullptr);
-        return;
-      }
-
-      /* move to next mr if necessary */
-      if (mr_it == it->end()) {
-        if (++it != map->mrs.end()) 
-          mr_it = it->begin();
-        else { /* if we hit end */
-          mr_it = mem_region_t::iterator(nullptr);
-          return;
-        }
-      }
-      
-      /* record start */
-      current.first.start = it->itr_to_addr(mr_it);
-      current.second = *mr_it;
-
-      /* pass over all contiguous identical tags */
-      do {
-        ++mr_it;
-      } while (((mr_it) != it->end()) && (*mr_it == *(mr_it - 1)));
-
-      /* record end */
-      if (mr_it == it->end())
-        current.first.end = it->range.end;
-      else
-        current.first.end = it->itr_to_addr(mr_it);
+    void update() {
+      if (it != map->runs.end())
+        current = result_type_t(range_t{it->first, it->second.end}, it->second.metadata);
     }
-  
+
   public:
     /* constructor for iterator */
-    ForwardIterator(MMap* map, bool begin) : map(map) {
-      if (begin && (map->mrs.begin() != map->mrs.end())) {
-        it = map->mrs.begin();
-        mr_it = it->begin();
-        advance(); // set current to the 0th val
-      } else { // bool implies end or the struct is empty
-        it = map->mrs.end();
-        mr_it = mem_region_t::iterator(nullptr);
-      }
-    }
-  
+    ForwardIterator(MMap* map, bool begin) : map(map), it(begin ? map->runs.begin() : map->runs.end()) { update(); }
+
     // Pre-increment
     ForwardIterator& operator ++() {
-      advance();
+      ++it;
+      update();
       return *this;
     }
-  
+
     // Post-increment
     ForwardIterator operator ++(int) {
       ForwardIterator tmp(*this);
-      advance();
-      return tmp; 
+      ++*this;
+      return tmp;
     }
-  
+
     // two-way comparison: v.begin() == v.cbegin() and vice versa
-    template<class OtherMMap, class OtherMRIterator, class OtherMRVIterator>
-    bool operator ==(const ForwardIterator<OtherMMap, OtherMRIterator, OtherMRVIterator>& rhs) const {
-      return ((it == map->mrs.end()) && (rhs.it == rhs.map->mrs.end())) || (((mr_it - it->begin()) == (rhs.mr_it - rhs.it->begin())) && (it == rhs.it));
-    }
-    template<class OtherMMap, class OtherMRIterator, class OtherMRVIterator>
-    bool operator !=(const ForwardIterator<OtherMMap, OtherMRIterator, OtherMRVIterator>& rhs) const {
-      return !(*this == rhs);
-    }
-  
+    template<class OtherMMap, class OtherRunIterator>
+    bool operator ==(const ForwardIterator<OtherMMap, OtherRunIterator>& rhs) const { return it == rhs.it; }
+    template<class OtherMMap, class OtherRunIterator>
+    bool operator !=(const ForwardIterator<OtherMMap, OtherRunIterator>& rhs) const { return !(*this == rhs); }
+
     reference operator *() { return current; }
     pointer operator ->() { return &current; }
   };
 
-  using iterator = ForwardIterator<metadata_memory_map_t, mem_region_t::iterator, std::vector<mem_region_t>::iterator>;
-  using const_iterator = ForwardIterator<const metadata_memory_map_t, mem_region_t::const_iterator, std::vector<mem_region_t>::const_iterator>;
+  using iterator = ForwardIterator<metadata_memory_map_t, std::map<uint64_t, run_t>::const_iterator>;
+  using const_iterator = ForwardIterator<const metadata_memory_map_t, std::map<uint64_t, run_t>::const_iterator>;
 
   iterator begin() { return iterator(this, true); }
   iterator end() { return iterator(this, false); }
@@ -183,8 +141,39 @@ public:
   const_iterator cbegin() const noexcept { return const_iterator(this, true); }
   const_iterator cend() const noexcept { return const_iterator(this, false); }
 
+  /**
+   * Looks up metadata for a series of addresses.  Each lookup starts from the run the last one found,
+   * so visiting addresses in increasing order costs amortized constant time per lookup; an address
+   * far from the last falls back to a search of the whole map.  Invalidated by add_range().
+   */
+  class cursor_t {
+  private:
+    static constexpr int max_steps = 8;
+
+    const metadata_memory_map_t* map;
+    std::map<uint64_t, run_t>::const_iterator it;
+
+  public:
+    cursor_t(const metadata_memory_map_t& map) : map(&map), it(map.runs.begin()) {}
+
+    const metadata_t* get_metadata(uint64_t addr) {
+      if (it != map->runs.end() && it->first <= addr) {
+        for (int i = 0; i < max_steps && it != map->runs.end() && it->second.end <= addr; i++)
+          ++it;
+        if (it == map->runs.end() || addr < it->second.end)
+          return it != map->runs.end() && it->first <= addr ? it->second.metadata : nullptr;
+      }
+      it = map->run_at(addr);
+      return it != map->runs.end() && it->first <= addr ? it->second.metadata : nullptr;
+    }
+  };
+
+  // adds metadata to the words in [start, end), both of which are rounded down to a word boundary
   void add_range(uint64_t start, uint64_t end, const metadata_t& metadata);
   const metadata_t* get_metadata(uint64_t addr) const;
+  cursor_t cursor() const { return cursor_t(*this); }
+  size_t distinct_metadata() const { return md_cache.size(); }
+  size_t run_count() const { return runs.size(); }
 };
 
 } // namespace policy_engine
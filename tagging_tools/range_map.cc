@@ -4,6 +4,8 @@
 #include <cstdlib>
 #include <fstream>
 #include <iostream>
+#include <iterator>
+#include <map>
 #include <string>
 #include <tuple>
 #include <unistd.h>
@@ -24,21 +26,52 @@ const std::string range_map_t::RWX_R = "elf.Section.SHF_ALLOC";
 const std::string range_map_t::RWX_W = "elf.Section.SHF_WRITE";
 
 bool range_map_t::contains(const tagged_range_t& key) const {
-  const auto& [ range, tags ] = key;
-  return std::any_of(range_map.begin(), range_map.end(), [&](const tagged_range_t& tagged) {
-    const auto& [ r, t ] = tagged;
-    return range.start >= r.start && range.end <= r.end;
-  });
+  auto it = staircase.upper_bound(key.range.start);
+  return it != staircase.begin() && std::prev(it)->second >= key.range.end;
+}
+
+uint64_t range_map_t::covered_to(uint64_t addr) const {
+  auto it = staircase.upper_bound(addr);
+  return it == staircase.begin() ? 0 : std::prev(it)->second;
+}
+
+uint64_t range_map_t::next_start(uint64_t addr) const {
+  auto it = staircase.upper_bound(addr);
+  return it == staircase.end() ? UINT64_MAX : it->first;
 }
 
 void range_map_t::add_range(uint64_t start, uint64_t end, const std::vector<std::string>& tags) {
-  for (auto& [ r, t ] : range_map) {
-    if (r.start == start && r.end == end) {
-      t.insert(t.end(), tags.begin(), tags.end());
-      return;
-    }
+  if (auto it = indexes.find(range_t{start, end}); it != indexes.end()) {
+    std::vector<std::string>& t = range_map[it->second].tags;
+    t.insert(t.end(), tags.begin(), tags.end());
+    return;
   }
+  size_t index = range_map.size();
+  indexes[range_t{start, end}] = index;
   range_map.push_back(tagged_range_t{{start, end}, tags});
+
+  // add a step unless another range already contains this one, then drop the steps it contains
+  auto it = staircase.upper_bound(start);
+  if (it != staircase.begin() && std::prev(it)->second >= end)
+    return;
+
+  // This range owns the parts of it no earlier range covers, which are the gaps between the steps
+  // it overlaps.  All but the first and last of those are inside it and about to be dropped.
+  uint64_t covered = it == staircase.begin() ? start : std::max(start, std::prev(it)->second);
+  while (covered < end) {
+    uint64_t gap_end = it == staircase.end() ? end : std::min(end, it->first);
+    if (covered < gap_end) {
+      owners[covered] = index;
+      owners.emplace(gap_end, npos); // unless an earlier range starts there
+    }
+    if (gap_end == end)
+      break;
+    covered = std::max(covered, it++->second);
+  }
+
+  auto step = staircase.insert_or_assign(start, end).first;
+  for (auto it = std::next(step); it != staircase.end() && it->second <= end;)
+    it = staircase.erase(it);
 }
 
 void range_map_t::add_rwx_ranges(const elf_image_t& ef, reporter_t& err) {
@@ -79,10 +112,10 @@ void range_map_t::add_soc_ranges(const std::string& soc_file, const YAML::Node&
 const std::vector<std::string> empty;
 
 const std::vector<std::string>& range_map_t::get_tags(uint64_t addr) const {
-  for (const tagged_range_t& tagged : range_map)
-    if (tagged.range.contains(addr))
-      return tagged.tags;
-  return empty;
+  auto it = owners.upper_bound(addr);
+  if (it == owners.begin() || std::prev(it)->second == npos)
+    return empty;
+  return range_map[std::prev(it)->second].tags;
 }
 
 std::vector<range_t> range_map_t::get_ranges(const std::string& tag) const {
@@ -4,6 +4,7 @@
 #include <cstdint>
 #include <cstdio>
 #include <fstream>
+#include <map>
 #include <string>
 #include <vector>
 #include <yaml-cpp/yaml.h>
@@ -18,12 +19,26 @@ struct tagged_range_t {
   std::vector<std::string> tags;
 };
 
+/**
+ * Tagged ranges in the order they were first added.  Alongside them it keeps an index of where each
+ * distinct range is, so adding tags to a range that's already there doesn't search, and a
+ * "staircase" of the ranges that aren't inside any other, sorted by start, whose ends therefore
+ * increase too.  Whether anything contains a range is then a matter of checking the end of the last
+ * step that starts at or before it.  It also splits the addresses covered into pieces owned by the
+ * first range added over them, which is the one get_tags() answers with.  Ranges can only be read
+ * through operator [] and iterators, so they can't get out of step with the indexes.
+ */
 class range_map_t {
 private:
   std::vector<tagged_range_t> range_map;
+  std::map<range_t, size_t> indexes;
+  std::map<uint64_t, uint64_t> staircase; // start -> end
+  std::map<uint64_t, size_t> owners;       // start of each piece -> index of its range, or npos past the end of one
+
+  static constexpr size_t npos = ~(size_t)0;
 
 public:
-  using iterator = typename decltype(range_map)::iterator;
+  using iterator = typename decltype(range_map)::const_iterator;
   using const_iterator = typename decltype(range_map)::const_iterator;
 
   static const std::string RWX_X;
@@ -33,14 +48,14 @@ public:
   range_map_t() {}
 
   bool contains(const tagged_range_t& key) const;
+  // furthest end of any range that starts at or before addr, or 0 if there isn't one
+  uint64_t covered_to(uint64_t addr) const;
+  // start of the first range after addr that reaches past covered_to(addr), or UINT64_MAX
+  uint64_t next_start(uint64_t addr) const;
 
-  tagged_range_t& operator [](int i) { return range_map[i]; }
   const tagged_range_t& operator [](int i) const { return range_map[i]; }
-  tagged_range_t& at(int i) { return range_map.at(i); }
   const tagged_range_t& at(int i) const { return range_map.at(i); }
 
-  iterator begin() noexcept { return range_map.begin(); }
-  iterator end() noexcept { return range_map.end(); }
   const_iterator begin() const noexcept { return range_map.begin(); }
   const_iterator end() const noexcept { return range_map.end(); }
   const_iterator cbegin() const noexcept { return range_map.cbegin(); }
@@ -50,6 +65,7 @@ public:
   void add_range(uint64_t start, uint64_t end, const std::vector<std::string>& tags);
   void add_rwx_ranges(const elf_image_t& ef, reporter_t& err);
   void add_soc_ranges(const std::string& soc_file, const YAML::Node& policy_inits, reporter_t& err);
+  // tags of the first range added that contains addr
   const std::vector<std::string>& get_tags(uint64_t addr) const;
   std::vector<range_t> get_ranges(const std::string& tag) const;
 };
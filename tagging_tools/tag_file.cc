@@ -269,27 +269,16 @@ void write_tag_file(
     metadata_index_map_t<metadata_memory_map_t, range_t> memory_index_map(metadata_memory_map);
     metadata_values.insert(metadata_values.end(), memory_index_map.metadata.begin(), memory_index_map.metadata.end());
 
-    // Add any metadata from initial register/SOC/CSR assignments that's not already in metadata_values
+    // Add any metadata from initial register/SOC/CSR assignments that's not already in metadata_values; each
+    // index map's metadata starts with the values it was given and appends the ones that are new
     metadata_index_map_t<metadata_register_map_t, std::string> register_index_map(factory.lookup_metadata_map("ISA.RISCV.Reg"), metadata_values);
-    for(const auto& metadata : register_index_map.metadata){
-      const auto it = std::find_if(metadata_values.begin(), metadata_values.end(), [&metadata](const metadata_t* v){ return *v == *metadata; });
-      if (it == metadata_values.end())
-          metadata_values.push_back(metadata);
-    }
+    metadata_values = register_index_map.metadata;
 
     metadata_index_map_t<metadata_register_map_t, std::string> soc_index_map(factory.lookup_metadata_map("SOC"), metadata_values);
-    for(const auto& metadata : soc_index_map.metadata){
-      const auto it = std::find_if(metadata_values.begin(), metadata_values.end(), [&metadata](const metadata_t* v){ return *v == *metadata; });
-      if (it == metadata_values.end())
-          metadata_values.push_back(metadata);
-    }
+    metadata_values = soc_index_map.metadata;
 
     metadata_index_map_t<metadata_register_map_t, std::string> csr_index_map(factory.lookup_metadata_map("ISA.RISCV.CSR"), metadata_values);
-    for(const auto& metadata : csr_index_map.metadata){
-      const auto it = std::find_if(metadata_values.begin(), metadata_values.end(), [&metadata](const metadata_t* v){ return *v == *metadata; });
-      if (it == metadata_values.end())
-          metadata_values.push_back(metadata);
-    }
+    metadata_values = csr_index_map.metadata;
 
     // Separate the default entries from those corresponding to actual registers/CSRs
     int register_default = -1;
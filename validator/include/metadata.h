@@ -27,44 +27,96 @@
 #ifndef METADATA_H
 #define METADATA_H
 
+#include <algorithm>
 #include <cassert>
 #include <cstdint>
 #include <cstdlib>
 #include <functional>
 #include <iterator>
 #include <memory>
-#include <set>
+#include <vector>
 #include "policy_meta_set.h"
 #include "policy_types.h"
 
 namespace policy_engine {
 
+/**
+ * A set of metadata, kept as a sorted vector so that the handful of tags a range usually has is one
+ * small allocation that's quick to copy, compare and merge.  hash is the sum of a mix of each
+ * element, which doesn't depend on the order they were added in and is kept up to date as they are.
+ */
 struct metadata_t {
   std::size_t hash = 0;
-  std::set<meta_t> tags;
+  std::vector<meta_t> tags;
+
+  static std::size_t hash_of(meta_t m) {
+    uint64_t x = (uint64_t)m + 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30))*0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27))*0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+  }
 
   size_t size() const { return tags.size(); }
 
-  bool operator ==(const metadata_t &rhs) const { return tags == rhs.tags; }
+  bool operator ==(const metadata_t &rhs) const { return hash == rhs.hash && tags == rhs.tags; }
   bool operator !=(const metadata_t &rhs) const { return !(*this == rhs); }
 
   void insert(const meta_t &rhs) {
-    hash += rhs;
-    tags.insert(rhs);
+    auto it = std::lower_bound(tags.begin(), tags.end(), rhs);
+    if (it == tags.end() || *it != rhs) {
+      tags.insert(it, rhs);
+      hash += hash_of(rhs);
+    }
   }
 
+  // union with another set, merging the two sorted vectors
   template<class MetadataPtr> void insert(const MetadataPtr rhs) {
-    hash += rhs->hash;
-    tags.insert(rhs->begin(), rhs->end());
+    if (rhs->size() == 0)
+      return;
+    if (tags.empty()) {
+      tags.assign(rhs->begin(), rhs->end());
+      hash = rhs->hash;
+      return;
+    }
+    std::vector<meta_t> merged;
+    merged.reserve(tags.size() + rhs->size());
+    auto a = tags.cbegin();
+    auto b = rhs->begin();
+    while (a != tags.cend() && b != rhs->end()) {
+      if (*a < *b) {
+        merged.push_back(*a++);
+      } else {
+        if (*b < *a)
+          hash += hash_of(*b);
+        else
+          a++;
+        merged.push_back(*b++);
+      }
+    }
+    merged.insert(merged.end(), a, tags.cend());
+    for (; b != rhs->end(); b++) {
+      hash += hash_of(*b);
+      merged.push_back(*b);
+    }
+    tags.swap(merged);
   }
 
-  typedef std::set<meta_t>::iterator iterator;
-  typedef std::set<meta_t>::const_iterator const_iterator;
+  // elements can't be changed in place, which would leave them out of order
+  typedef std::vector<meta_t>::const_iterator iterator;
+  typedef std::vector<meta_t>::const_iterator const_iterator;
 
   const_iterator begin() const { return tags.begin(); }
   const_iterator end() const { return tags.end(); }
-  iterator begin() { return tags.begin(); }
-  iterator end() { return tags.end(); }
+};
+
+// hash and equality for pointers to metadata by what they point to, for sets that weren't canonized
+// by the same cache
+struct metadata_ptr_hash_t {
+  std::size_t operator ()(const metadata_t* md) const { return md->hash; }
+};
+
+struct metadata_ptr_equal_t {
+  bool operator ()(const metadata_t* lhs, const metadata_t* rhs) const { return *lhs == *rhs; }
 };
 
 } // namespace policy_engine
@@ -78,7 +130,7 @@ struct hash<policy_engine::metadata_t> {
 
 template<>
 struct equal_to<policy_engine::metadata_t> {
-  bool operator ()(const policy_engine::metadata_t& lhs, const policy_engine::metadata_t& rhs) const { return lhs.tags == rhs.tags; }
+  bool operator ()(const policy_engine::metadata_t& lhs, const policy_engine::metadata_t& rhs) const { return lhs == rhs; }
 };
 
 } // namespace std
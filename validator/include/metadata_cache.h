@@ -27,23 +27,25 @@
 #ifndef METADATA_CACHE_H
 #define METADATA_CACHE_H
 
-#include <list>
+#include <cstddef>
+#include <unordered_set>
 #include "metadata.h"
 
 namespace policy_engine {
 
+/**
+ * Interns metadata sets so that equal sets share one copy, which can then be compared by address.
+ * Elements of an unordered_set are never moved by a rehash, so a returned reference stays valid for
+ * the life of the cache.
+ */
 class metadata_cache_t {
 private:
-  std::list<metadata_t> canon;
+  std::unordered_set<metadata_t> canon;
 
 public:
-  metadata_t& canonize(const metadata_t& md) {
-    for (metadata_t& m : canon)
-      if (md == m)
-        return m;
-    canon.push_back(md);
-    return canon.back();
-  }
+  const metadata_t& canonize(const metadata_t& md) { return *canon.insert(md).first; }
+
+  size_t size() const { return canon.size(); }
 };
 
 } // namespace policy_engine
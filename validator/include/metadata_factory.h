@@ -31,7 +31,10 @@
 #include <cstdio>
 #include <map>
 #include <memory>
+#include <string>
+#include <string_view>
 #include <unordered_map>
+#include <unordered_set>
 #include <vector>
 #include <yaml-cpp/yaml.h>
 #include "metadata.h"
@@ -56,27 +59,40 @@ private:
   std::unordered_map<meta_t, std::string> abbrev_reverse_encoding_map; // for rendering
   std::unordered_map<std::string, meta_t> encoding_map;
   std::unordered_map<std::string, std::unique_ptr<const metadata_t>> path_map;
-  std::unordered_map<std::string, std::unique_ptr<const metadata_t>> group_map;
-  std::unordered_map<std::string, opgroup_rule_t> opgroup_rule_map;
+  // keyed by mnemonic, viewing the names in opgroup_names so a decoded instruction's name can be
+  // looked up without copying it
+  std::unordered_set<std::string> opgroup_names;
+  std::unordered_map<std::string_view, std::unique_ptr<const metadata_t>> group_map;
+  std::unordered_map<std::string_view, opgroup_rule_t> opgroup_rule_map;
 
   std::map<std::string, entity_init_t> entity_initializers;
 
+  // what tag_opcodes() does with a stretch of code: tags it with metadata or, if there isn't any, warns
+  struct opcode_run_t {
+    int start;
+    int end;
+    const metadata_t* metadata;
+    std::string warning;
+  };
+
   std::string abbreviate(const std::string& dotted_string);
 
   void init_entity_initializers(const YAML::Node& reqsAST, const std::string& prefix);
   void update_entity_initializers(const YAML::Node& metaAST, const std::string& prefix);
   void init_encoding_map(const YAML::Node& rawEnc);
   void init_group_map(const YAML::Node& groupAST);
-  void update_rule_map(std::string key, const YAML::Node& node);
+  void update_rule_map(std::string_view key, const YAML::Node& node);
 
   YAML::Node load_yaml(const std::string& yml_file);
 
+  int decode_opcodes(std::vector<opcode_run_t>& runs, uint64_t base_address, int xlen, const void* bytes, int pc, int stop);
+
 public:
   metadata_factory_t(const std::string& policy_dir);
 
   const metadata_t* lookup_metadata(const std::string& dotted_path);
   std::map<std::string, const metadata_t*> lookup_metadata_map(const std::string& dotted_path);
-  const metadata_t* lookup_group_metadata(const std::string& opgroup, const decoded_instruction_t& inst);
+  const metadata_t* lookup_group_metadata(std::string_view opgroup, const decoded_instruction_t& inst);
 
   bool apply_tag(metadata_memory_map_t& map, uint64_t start, uint64_t end, const std::string& tag_name);
   template<class RangeMap=range_map_t>
@@ -87,7 +103,7 @@ public:
           throw std::out_of_range("could not find tag " + tag);
   }
 
-  void tag_opcodes(metadata_memory_map_t& map, uint64_t base_address, int xlen, const void* bytes, int n, reporter_t& err);
+  void tag_opcodes(metadata_memory_map_t& map, uint64_t base_address, int xlen, const void* bytes, int n, reporter_t& err, unsigned threads=1);
   void tag_entities(metadata_memory_map_t& md_map, const elf_image_t& img, const std::vector<std::string>& yaml_files, reporter_t& err);
   std::vector<std::string> enumerate();
 
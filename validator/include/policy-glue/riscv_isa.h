@@ -66,7 +66,7 @@ static const flags_t has_csr_store{false, false, false, true, false};
 static const flags_t is_compressed{false, false, false, false, true};
 
 struct decoded_instruction_t {
-  const std::string name; // instruction name
+  const char* name;       // mnemonic, a static string that is empty for invalid instructions
   const op_t op;          // opcode defined in inst_decoder.h
   const option<int> rd;   // register id
   const option<int> rs1;  // register id
@@ -75,10 +75,19 @@ struct decoded_instruction_t {
   const option<int> imm;  // signed immediate value
   const flags_t flags;
 
-  explicit operator bool() const { return !name.empty(); }
+  explicit operator bool() const { return op != RISCV_INVALID; }
 };
 
-decoded_instruction_t decode(insn_bits_t bits, int xlen);
+enum decoder_mode_t {
+  DECODER_TABLE,    // opcode dispatch table for 32-bit instructions and a predecoded table for 16-bit ones
+  DECODER_REFERENCE // tries each instruction format in turn; slower, but the definition of correct
+};
+
+decoded_instruction_t decode(insn_bits_t bits, int xlen, decoder_mode_t mode=DECODER_TABLE);
+
+// Base mnemonic of an opcode.  Compressed instructions share opcodes with their expansions, so this
+// is "addi" for c.addi, c.li and c.nop; use decoded_instruction_t::name for the exact mnemonic.
+const char* op_name(op_t op);
 
 extern "C" {
 #endif // __cplusplus
@@ -147,15 +156,17 @@ struct equal_to<policy_engine::operands_t> {
 template<>
 struct hash<policy_engine::operands_t> {
   size_t operator ()(const policy_engine::operands_t& ops) const {
-    // XOR all meta_set_t pointers (operands) together.
-    // Shift pointers slightly so that two identical
-    // tags don't cancel out to 0.
-    size_t hash = ops.pc;
-    hash ^= ops.ci  << 1;
-    hash ^= ops.op1 << 2;
-    hash ^= ops.op2 << 3;
-    hash ^= ops.op3 << 4;
-    hash ^= ops.mem << 5;
+    // Tags are small dense integers, so combine them polynomially and then mix so that every operand
+    // affects every bit of the result.
+    uint64_t hash = ops.pc;
+    hash = hash*0x9e3779b97f4a7c15ULL + ops.ci;
+    hash = hash*0x9e3779b97f4a7c15ULL + ops.op1;
+    hash = hash*0x9e3779b97f4a7c15ULL + ops.op2;
+    hash = hash*0x9e3779b97f4a7c15ULL + ops.op3;
+    hash = hash*0x9e3779b97f4a7c15ULL + ops.mem;
+    hash ^= hash >> 32;
+    hash *= 0xd6e8feb86659fd93ULL;
+    hash ^= hash >> 32;
     return hash;
   }
 };
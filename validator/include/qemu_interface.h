@@ -36,6 +36,30 @@ extern "C" {
 
 uint32_t e_v_validate(uint64_t pc, uint32_t instr);
 
+/* Status bits reported by e_v_step */
+#define E_V_STEP_RULE_CACHE_HIT 0x1 /* rule came from the rule cache */
+#define E_V_STEP_VIOLATION      0x2 /* policy violation, nothing was committed */
+#define E_V_STEP_WATCH          0x4 /* commit changed a watched tag */
+
+/* Validates and, if allowed, commits one instruction.  Returns 1 if the instruction is allowed and
+ * reports status through flags. */
+uint32_t e_v_step(uint64_t pc, uint32_t instr, uint64_t mem_addr, uint32_t* flags);
+
+/* One instruction of a batch passed to e_v_validate_batch */
+typedef struct e_v_trace_record {
+  uint64_t pc;
+  uint64_t mem_addr;
+  uint32_t instr;
+} e_v_trace_record_t;
+
+/* Validates and commits n instructions in order.  If rs1_values is not null, it holds the value of
+ * each instruction's rs1 register, which is used with the immediate to compute memory addresses
+ * instead of mem_addr.  Stops at the first violation, whose details are then available through
+ * e_v_violation_msg, or after the first instruction that changes a watched tag.  Returns the index
+ * of the instruction it stopped at, or n if it ran the whole batch, and sets E_V_STEP_VIOLATION or
+ * E_V_STEP_WATCH in flags to say why. */
+uint64_t e_v_validate_batch(const e_v_trace_record_t* records, const uint64_t* rs1_values, uint64_t n, uint32_t* flags);
+
 void e_v_set_callbacks(RegisterReader_t reg_reader, MemoryReader_t mem_reader, AddressFixer_t addr_fixer);
 uint32_t e_v_commit(void);
 void e_v_set_metadata(const char* validator_cfg_path);
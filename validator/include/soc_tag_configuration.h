@@ -28,6 +28,7 @@
 #define SOC_TAG_CONFIGURATION_H
 
 #include <list>
+#include <memory>
 #include <string>
 #include <yaml-cpp/yaml.h>
 #include "meta_cache.h"
@@ -39,18 +40,24 @@ namespace policy_engine {
 
 class soc_tag_configuration_t {
 public:
+  // how a heterogeneous element keeps its tags
+  enum storage_t { DENSE, INTERVAL };
+
   struct soc_element_t {
     address_t start;
     address_t end;
     bool heterogeneous;
     size_t tag_granularity = 4;
     size_t word_size = 4;
+    size_t tag_width = default_tag_width; // bytes each tag takes in memory, to start with
+    storage_t storage = DENSE;
     tag_t tag;
   };
 
 private:
   std::list<soc_element_t> elements;
   meta_set_factory_t* factory;
+  size_t tag_width;
 
   void process_element(const std::string& element_name, const YAML::Node& n, int xlen);
 
@@ -62,6 +69,15 @@ public:
 
   void apply(tag_bus_t* tag_bus, meta_set_cache_t* ms_cache);
 
+  // bytes each tag takes in memory to start with, from the optional root tag_width node
+  size_t get_tag_width() const { return tag_width; }
+
+  // Dense heterogeneous elements larger than this get paged tag storage rather than a flat array.
+  static constexpr address_t paged_threshold = 1 << 20;
+
+  // Creates the tag storage apply() uses for an element.
+  static std::unique_ptr<tag_provider_t> make_provider(const soc_element_t& e);
+
   iterator begin() { return elements.begin(); }
   iterator end() { return elements.end(); }
   const_iterator begin() const { return elements.begin(); }
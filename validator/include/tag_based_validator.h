@@ -48,7 +48,7 @@ public:
   virtual bool commit() = 0;
 
   // Provides the tag for a given address.  Used for debugging.
-  virtual tag_t& get_tag(address_t addr) = 0;
+  virtual tag_t get_tag(address_t addr) = 0;
   virtual const meta_set_t& get_meta_set(address_t addr) = 0;
 };
 
@@ -27,7 +27,9 @@
 #ifndef TAG_UTILS_H
 #define TAG_UTILS_H
 
+#include <algorithm>
 #include <assert.h>
+#include <cstring>
 #include <stdint.h>
 #include <stdio.h>
 #include <vector>
@@ -49,11 +51,296 @@ namespace policy_engine {
  */
 #define PRItag PRIdPTR
 
+// Out of line so the bounds checks that call it stay small.
+[[noreturn]] __attribute__((noinline, cold)) inline void throw_bad_address(address_t addr) {
+  char buf[64];
+  std::sprintf(buf, "bad address %#lx", addr);
+  throw std::out_of_range(buf);
+}
+
+
+// Tags are stored in 2, 4 or 8 bytes apiece.  Storage starts out this wide, or as wide as the SOC
+// configuration asks for, and is widened when a policy creates a tag too large for it.
+static constexpr size_t default_tag_width = 2;
+
+// log2 of the bytes needed to store tag
+inline unsigned tag_width_shift(tag_t tag) {
+  if (tag <= UINT16_MAX)
+    return 1;
+  else if (tag <= UINT32_MAX)
+    return 2;
+  else
+    return 3;
+}
+
+// log2 of a tag width in bytes
+inline unsigned width_shift_of(size_t tag_width) {
+  return tag_width <= 2 ? 1 : tag_width <= 4 ? 2 : 3;
+}
+
+// log2 of the bytes a data tag applies to, for a power of two tag_granularity
+inline unsigned granularity_shift_of(size_t tag_granularity) {
+  return std::max<unsigned>(__builtin_ctzl(tag_granularity), __builtin_ctzl(MIN_TAG_GRANULARITY));
+}
+
+// largest tag that can be stored in 1 << width_shift bytes
+inline tag_t max_stored_tag(unsigned width_shift) {
+  return width_shift >= 3 ? ~(tag_t)0 : ((tag_t)1 << (8 << width_shift)) - 1;
+}
+
+// Reads and writes tag i of an array of tags stored 1 << width_shift bytes apiece.
+inline tag_t read_tag(const uint8_t* tags, size_t i, unsigned width_shift) {
+  switch (width_shift) {
+    case 1: { uint16_t t; std::memcpy(&t, tags + (i << 1), sizeof(t)); return t; }
+    case 2: { uint32_t t; std::memcpy(&t, tags + (i << 2), sizeof(t)); return t; }
+    default: { tag_t t; std::memcpy(&t, tags + (i << 3), sizeof(t)); return t; }
+  }
+}
+
+// Same as read_tag(), but without branching on the width, which differs from one region to the
+// next.  This reads a whole tag_t, so arrays need sizeof(tag_t) bytes of padding at the end.
+inline tag_t read_padded_tag(const uint8_t* tags, size_t i, unsigned width_shift, tag_t max_tag) {
+#if __BYTE_ORDER__ == __ORDER_LITTLE_ENDIAN__
+  tag_t t;
+  std::memcpy(&t, tags + (i << width_shift), sizeof(t));
+  return t & max_tag;
+#else
+  return read_tag(tags, i, width_shift);
+#endif
+}
+
+inline void write_tag(uint8_t* tags, size_t i, unsigned width_shift, tag_t tag) {
+  switch (width_shift) {
+    case 1: { uint16_t t = tag; std::memcpy(tags + (i << 1), &t, sizeof(t)); break; }
+    case 2: { uint32_t t = tag; std::memcpy(tags + (i << 2), &t, sizeof(t)); break; }
+    default: std::memcpy(tags + (i << 3), &tag, sizeof(tag)); break;
+  }
+}
+
+// Sets tags from up to to in an array of tags stored 1 << width_shift bytes apiece.
+inline void fill_tags(uint8_t* tags, size_t from, size_t to, unsigned width_shift, tag_t tag) {
+  switch (width_shift) {
+    case 1: for (size_t i = from; i < to; i++) write_tag(tags, i, 1, tag); break;
+    case 2: for (size_t i = from; i < to; i++) write_tag(tags, i, 2, tag); break;
+    default: for (size_t i = from; i < to; i++) write_tag(tags, i, 3, tag); break;
+  }
+}
+
+/**
+ * Where a provider keeps its tags, if they're in memory the tag bus can index itself rather than
+ * calling the provider.  Tags are split into pages: for an offset a into the region, the tag is
+ * number (a & page_mask) >> index_shift of page pages[a >> page_shift].  Each tag takes
+ * 1 << width_shift bytes, and pages are padded with sizeof(tag_t) bytes after the last one.  A
+ * provider with one flat array has a single page and a page_shift past any offset.  Pages equal to
+ * shared_page are read-only, and tags above max_tag don't fit; both have to be written through the
+ * provider so it can copy the page or widen its tags first.  Instruction tags at offsets with any of
+ * insn_mask set are kept apart from the data tags and also have to go through the provider.
+ * Providers that don't keep their tags in memory leave pages null.
+ */
+struct tag_storage_t {
+  uint8_t* const* pages = nullptr;
+  unsigned page_shift = 63;
+  address_t page_mask = ~(address_t)0;
+  const uint8_t* shared_page = nullptr;
+  unsigned index_shift = 0;
+  unsigned width_shift = 3;
+  tag_t max_tag = ~(tag_t)0;
+  address_t insn_mask = 0;
+};
+
+/**
+ * An array of tags stored in as few bytes apiece as the largest tag written to it needs, but no fewer
+ * than it was created with.  Storing a larger tag widens the whole array.  If page_bits is set the
+ * array is split into pages of 1 << page_bits tags, which start out sharing one page filled with the
+ * initial tag and get their own copy the first time a different tag is written to them, so memory
+ * use follows what's actually written rather than the size of the array.
+ */
+class tag_array_t {
+private:
+  size_t n;
+  unsigned page_bits;   // 63 if the array is one page
+  unsigned width_shift; // log2 of the bytes each tag takes
+  size_t page_tags;
+  std::unique_ptr<uint8_t[]> shared_page;
+  std::vector<uint8_t*> pages;
+  std::vector<std::unique_ptr<uint8_t[]>> owned_pages;
+
+  // padded for read_padded_tag()
+  uint8_t* new_page(unsigned shift) { return new uint8_t[(page_tags << shift) + sizeof(tag_t)](); }
+
+  void widen(unsigned shift) {
+    auto convert = [&](const uint8_t* from) {
+      uint8_t* to = new_page(shift);
+      for (size_t i = 0; i < page_tags; i++)
+        write_tag(to, i, shift, read_tag(from, i, width_shift));
+      return to;
+    };
+    std::unique_ptr<uint8_t[]> widened_shared(shared_page ? convert(shared_page.get()) : nullptr);
+    std::vector<std::unique_ptr<uint8_t[]>> widened;
+    for (uint8_t*& page : pages) {
+      if (page == shared_page.get()) {
+        page = widened_shared.get();
+      } else {
+        widened.emplace_back(convert(page));
+        page = widened.back().get();
+      }
+    }
+    shared_page = std::move(widened_shared);
+    owned_pages = std::move(widened);
+    width_shift = shift;
+  }
+
+public:
+  tag_array_t() : tag_array_t(0, 0) {}
+
+  tag_array_t(size_t n, tag_t tag, size_t width = default_tag_width, unsigned page_bits = 0) :
+    n(n), page_bits(page_bits ? page_bits : 63), width_shift(std::max(tag_width_shift(tag), width_shift_of(width))) {
+    page_tags = page_bits ? (size_t)1 << page_bits : n + 1;
+    if (!n)
+      return;
+    uint8_t* page = new_page(width_shift);
+    for (size_t i = 0; i < page_tags; i++)
+      write_tag(page, i, width_shift, tag);
+    if (page_bits) {
+      shared_page.reset(page);
+      pages.assign((n >> page_bits) + 1, page);
+    } else {
+      owned_pages.emplace_back(page);
+      pages.push_back(page);
+    }
+  }
+
+  size_t size() const { return n; }
+  size_t width() const { return (size_t)1 << width_shift; }
+
+  tag_t operator[](size_t i) const {
+    return read_tag(pages[i >> page_bits], i & (((size_t)1 << page_bits) - 1), width_shift);
+  }
+
+  void set(size_t i, tag_t tag) {
+    if (tag > max_stored_tag(width_shift))
+      widen(tag_width_shift(tag));
+    uint8_t*& page = pages[i >> page_bits];
+    size_t j = i & (((size_t)1 << page_bits) - 1);
+    if (page == shared_page.get()) {
+      if (read_tag(page, j, width_shift) == tag)
+        return;
+      owned_pages.emplace_back(new_page(width_shift));
+      std::memcpy(owned_pages.back().get(), page, page_tags << width_shift);
+      page = owned_pages.back().get();
+    }
+    write_tag(page, j, width_shift, tag);
+  }
+
+  // Sets tags first up to last.  Pages that are entirely overwritten aren't copied first.
+  void fill(size_t first, size_t last, tag_t tag) {
+    if (first >= last)
+      return;
+    if (tag > max_stored_tag(width_shift))
+      widen(tag_width_shift(tag));
+    for (size_t i = first; i < last;) {
+      uint8_t*& page = pages[i >> page_bits];
+      size_t j = i & (((size_t)1 << page_bits) - 1);
+      size_t k = std::min(page_tags, j + (last - i));
+      i += k - j;
+      if (page == shared_page.get()) {
+        if (read_tag(page, 0, width_shift) == tag)
+          continue;
+        owned_pages.emplace_back(new_page(width_shift));
+        if (j > 0 || k < page_tags)
+          std::memcpy(owned_pages.back().get(), page, page_tags << width_shift);
+        page = owned_pages.back().get();
+      }
+      fill_tags(page, j, k, width_shift, tag);
+    }
+  }
+
+  // Describes the array to the tag bus, for offsets that index it shifted right by index_shift.
+  // Setting a tag can widen the array, which moves every page.
+  tag_storage_t storage(unsigned index_shift) const {
+    tag_storage_t s;
+    s.pages = pages.data();
+    s.page_shift = std::min(63u, page_bits + index_shift);
+    s.page_mask = ((address_t)1 << s.page_shift) - 1;
+    s.shared_page = shared_page.get();
+    s.index_shift = index_shift;
+    s.width_shift = width_shift;
+    s.max_tag = max_stored_tag(width_shift);
+    return s;
+  }
+
+  // pages that have their own copy, rather than sharing the initial one
+  size_t resident_pages() const { return owned_pages.size(); }
+};
+
 struct tag_provider_t {
   virtual ~tag_provider_t() {}
 
-  virtual tag_t& data_tag_at(address_t addr) = 0;
-  virtual tag_t& insn_tag_at(address_t addr) = 0;
+  // The tag for addr, throwing std::out_of_range if addr is past the end of the provider.  A provider
+  // only has to implement these; the calls below go through them unless it overrides those too.  The
+  // built-in providers pack their tags and have no tag_t to refer to, so they override the calls
+  // below instead, and may not support these.
+  virtual tag_t& data_tag_at(address_t) { throw std::logic_error("tag provider has no data_tag_at()"); }
+  virtual tag_t& insn_tag_at(address_t) { throw std::logic_error("tag provider has no insn_tag_at()"); }
+
+  // These return false, leaving tag unchanged, if addr is past the end of the provider.
+  virtual bool load_data_tag(address_t addr, tag_t& tag) {
+    try {
+      tag = data_tag_at(addr);
+      return true;
+    } catch (const std::out_of_range&) {
+      return false;
+    }
+  }
+
+  virtual bool load_insn_tag(address_t addr, tag_t& tag) {
+    try {
+      tag = insn_tag_at(addr);
+      return true;
+    } catch (const std::out_of_range&) {
+      return false;
+    }
+  }
+
+  virtual bool store_data_tag(address_t addr, tag_t tag) {
+    try {
+      data_tag_at(addr) = tag;
+      return true;
+    } catch (const std::out_of_range&) {
+      return false;
+    }
+  }
+
+  virtual bool store_insn_tag(address_t addr, tag_t tag) {
+    try {
+      insn_tag_at(addr) = tag;
+      return true;
+    } catch (const std::out_of_range&) {
+      return false;
+    }
+  }
+
+  // Sets the instruction tag of every word from start up to end, which are multiples of
+  // MIN_TAG_GRANULARITY, the same as storing it to each one.  Returns false if any of them is past
+  // the end of the provider; providers that override this check before setting any.
+  virtual bool fill_range(address_t start, address_t end, tag_t tag) {
+    for (address_t addr = start; addr < end; addr += MIN_TAG_GRANULARITY) {
+      if (!store_insn_tag(addr, tag))
+        return false;
+    }
+    return true;
+  }
+
+  // Sets start and end to the offsets whose instruction tags storing the data tag at addr can change.
+  // That's all of them unless a provider knows better, since it may keep one tag for the lot.
+  virtual void data_tag_span(address_t, address_t& start, address_t& end) {
+    start = 0;
+    end = ~(address_t)0;
+  }
+
+  // Lets the tag bus skip the virtual calls above.  Only the built-in providers override this; the
+  // bus calls any other provider for every tag.
+  virtual tag_storage_t storage() { return tag_storage_t(); }
 };
 
 class uniform_tag_provider_t : public tag_provider_t {
@@ -61,15 +348,26 @@ private:
   size_t tag_granularity; // number of bytes a tag applies to
   address_t size;
   tag_t tag;
+  uint8_t* page = reinterpret_cast<uint8_t*>(&tag);
+
+  bool load(address_t addr, tag_t& t) {
+    if (addr >= size)
+      return false;
+    t = tag;
+    return true;
+  }
+
+  bool store(address_t addr, tag_t t) {
+    if (addr >= size)
+      return false;
+    tag = t;
+    return true;
+  }
 
   tag_t& tag_at(address_t addr) {
-    if (addr < size)
-      return tag;
-    else {
-      char buf[64];
-      std::sprintf(buf, "bad address %#lx", addr);
-      throw std::out_of_range(buf);
-    }
+    if (addr >= size)
+      throw_bad_address(addr);
+    return tag;
   }
 
 public:
@@ -77,68 +375,435 @@ public:
 
   tag_t& data_tag_at(address_t addr) { return tag_at(addr); }
   tag_t& insn_tag_at(address_t addr) { return tag_at(addr); }
+
+  bool load_data_tag(address_t addr, tag_t& t) { return load(addr, t); }
+  bool load_insn_tag(address_t addr, tag_t& t) { return load(addr, t); }
+  bool store_data_tag(address_t addr, tag_t t) { return store(addr, t); }
+  bool store_insn_tag(address_t addr, tag_t t) { return store(addr, t); }
+
+  bool fill_range(address_t start, address_t end, tag_t t) {
+    return start >= end || store(end - MIN_TAG_GRANULARITY, t);
+  }
+
+  // every offset masks down to the one tag
+  tag_storage_t storage() {
+    tag_storage_t s;
+    s.pages = &page;
+    s.page_mask = 0;
+    s.width_shift = tag_width_shift(~(tag_t)0);
+    return s;
+  }
 };
 
+/**
+ * Tags for a heterogeneous region, one per tag_granularity bytes.  Instructions are tagged every
+ * MIN_TAG_GRANULARITY bytes, so if the granularity is coarser, the instruction tags of words that
+ * don't start a granule are kept apart in pages that are only allocated when one is written, which
+ * is normally just for code.  The instruction tag of a word that starts a granule is its data tag.
+ */
 class platform_ram_tag_provider_t : public tag_provider_t {
 private:
   address_t size;
-  size_t tag_granularity; // number of bytes a tag applies to
-  unsigned word_size;
-  std::vector<tag_t> tags;
+  unsigned granularity_shift; // log2 of the number of bytes a data tag applies to
+  address_t insn_mask;        // offset bits of the words with their own instruction tags
+  tag_array_t tags;
+  tag_array_t insn_tags;
+
+  static constexpr unsigned insn_page_shift = 14; // bytes of address space covered by a page of instruction tags
 
 public:
-  platform_ram_tag_provider_t(address_t size, tag_t tag, size_t word_size, size_t tag_granularity) :
-    size(size), word_size(word_size), tags(size/MIN_TAG_GRANULARITY + 1, tag), tag_granularity(tag_granularity) {}
-  
-  tag_t& data_tag_at(address_t addr) {
-    if (addr < size)
-      return tags[(addr & -tag_granularity)/MIN_TAG_GRANULARITY];
-    else {
-      char buf[64];
-      std::sprintf(buf, "bad address %#lx", addr);
-      throw std::out_of_range(buf);
-    }
+  // page_shift is log2 of the bytes of address space covered by a page of tags, or 0 for one array
+  platform_ram_tag_provider_t(address_t size, tag_t tag, size_t tag_granularity, size_t tag_width = default_tag_width, unsigned page_shift = 0) :
+    size(size), granularity_shift(granularity_shift_of(tag_granularity)),
+    insn_mask(((address_t)1 << granularity_shift) - MIN_TAG_GRANULARITY),
+    tags((size >> granularity_shift) + 1, tag, tag_width, page_shift ? std::max(page_shift, granularity_shift + 1) - granularity_shift : 0),
+    insn_tags(insn_mask ? size/MIN_TAG_GRANULARITY + 1 : 0, tag, tag_width, insn_page_shift - granularity_shift_of(MIN_TAG_GRANULARITY)) {}
+
+  bool load_data_tag(address_t addr, tag_t& tag) {
+    if (addr >= size)
+      return false;
+    tag = tags[addr >> granularity_shift];
+    return true;
+  }
+
+  bool load_insn_tag(address_t addr, tag_t& tag) {
+    if (addr >= size)
+      return false;
+    tag = addr & insn_mask ? insn_tags[addr/MIN_TAG_GRANULARITY] : tags[addr >> granularity_shift];
+    return true;
+  }
+
+  bool store_data_tag(address_t addr, tag_t tag) {
+    if (addr >= size)
+      return false;
+    tags.set(addr >> granularity_shift, tag);
+    return true;
+  }
+
+  bool store_insn_tag(address_t addr, tag_t tag) {
+    if (addr >= size)
+      return false;
+    if (addr & insn_mask)
+      insn_tags.set(addr/MIN_TAG_GRANULARITY, tag);
+    else
+      tags.set(addr >> granularity_shift, tag);
+    return true;
+  }
+
+  bool fill_range(address_t start, address_t end, tag_t tag) {
+    if (start >= end)
+      return true;
+    if (end - MIN_TAG_GRANULARITY >= size)
+      return false;
+    // the granules whose first word is in the range, then the rest of the words
+    address_t granule = (address_t)1 << granularity_shift;
+    tags.fill((start + granule - 1) >> granularity_shift, (end + granule - 1) >> granularity_shift, tag);
+    if (insn_mask)
+      insn_tags.fill(start/MIN_TAG_GRANULARITY, end/MIN_TAG_GRANULARITY, tag);
+    return true;
   }
 
-  tag_t& insn_tag_at(address_t addr) {
-    if (addr < size)
-      return tags[addr/MIN_TAG_GRANULARITY];
-    else {
-      char buf[64];
-      std::sprintf(buf, "bad address %#lx", addr);
-      throw std::out_of_range(buf);
+  // a data tag is the instruction tag of the first word of its granule, and of no other
+  void data_tag_span(address_t addr, address_t& start, address_t& end) {
+    start = addr >> granularity_shift << granularity_shift;
+    end = start + MIN_TAG_GRANULARITY;
+  }
+
+  tag_storage_t storage() {
+    tag_storage_t s = tags.storage(granularity_shift);
+    s.insn_mask = insn_mask;
+    return s;
+  }
+
+  // bytes each tag currently takes
+  size_t tag_width() const { return tags.width(); }
+
+  // pages of tags that have been given their own copy
+  size_t resident_pages() const { return tags.resident_pages() + insn_tags.resident_pages(); }
+};
+
+/**
+ * Tags for a large heterogeneous region, allocated a page at a time.  Every page starts out pointing
+ * at one shared page filled with the region's initial tag and gets its own copy the first time a
+ * different tag is written to it, so memory use follows what the guest actually touches rather
+ * than the size of the region, and nothing has to be filled in up front.
+ */
+class paged_tag_provider_t : public platform_ram_tag_provider_t {
+public:
+  static constexpr unsigned page_shift = 14; // bytes of address space covered by a page of tags
+
+  paged_tag_provider_t(address_t size, tag_t tag, size_t tag_granularity, size_t tag_width = default_tag_width) :
+    platform_ram_tag_provider_t(size, tag, tag_granularity, tag_width, page_shift) {}
+};
+
+/**
+ * Tags for a heterogeneous region that's mostly one tag, such as a heap that starts out with a
+ * default and gets a few tagged objects, kept as runs of words with the same tag.  A run is split
+ * when one of its words gets a different tag, and merged with its neighbour when they end up with
+ * the same one, so memory follows the number of runs rather than the size of the region.  Tags are
+ * laid out the same as for platform_ram_tag_provider_t: every word has an instruction tag, and the
+ * data tag of a granule is the instruction tag of its first word.
+ */
+class interval_tag_provider_t : public tag_provider_t {
+private:
+  address_t size;
+  unsigned granularity_shift; // log2 of the number of bytes a data tag applies to
+  std::map<address_t, tag_t> runs; // start of each run; it ends where the next one starts
+
+  // the run of the last lookup, which is empty once the runs change
+  address_t run_start = 0;
+  address_t run_end = 0;
+  tag_t run_tag = 0;
+
+  tag_t tag_of(address_t word) {
+    if (word - run_start < run_end - run_start)
+      return run_tag;
+    auto it = std::prev(runs.upper_bound(word));
+    auto next = std::next(it);
+    run_start = it->first;
+    run_end = next == runs.end() ? size : next->first;
+    run_tag = it->second;
+    return run_tag;
+  }
+
+  // Gives the words from start up to end one run.
+  void assign(address_t start, address_t end, tag_t tag) {
+    auto it = std::prev(runs.upper_bound(start));
+    auto next = std::next(it);
+    if (it->second == tag && (next == runs.end() || next->first >= end))
+      return;
+    run_start = run_end = 0;
+    if (end < size) {
+      auto last = std::prev(runs.upper_bound(end));
+      if (last->first != end)
+        runs.emplace_hint(std::next(last), end, last->second);
     }
+    if (it->first == start)
+      it->second = tag;
+    else
+      it = runs.emplace_hint(next, start, tag);
+    next = runs.erase(std::next(it), runs.lower_bound(end));
+    if (next != runs.end() && next->second == tag)
+      runs.erase(next);
+    if (it != runs.begin() && std::prev(it)->second == tag)
+      runs.erase(it);
+  }
+
+  void set(address_t word, tag_t tag) { assign(word, word + MIN_TAG_GRANULARITY, tag); }
+
+public:
+  interval_tag_provider_t(address_t size, tag_t tag, size_t tag_granularity) :
+    size(size), granularity_shift(granularity_shift_of(tag_granularity)) {
+    runs.emplace(0, tag);
+  }
+
+  bool load_data_tag(address_t addr, tag_t& tag) {
+    if (addr >= size)
+      return false;
+    tag = tag_of(addr >> granularity_shift << granularity_shift);
+    return true;
+  }
+
+  bool load_insn_tag(address_t addr, tag_t& tag) {
+    if (addr >= size)
+      return false;
+    tag = tag_of(addr & -(address_t)MIN_TAG_GRANULARITY);
+    return true;
   }
+
+  bool store_data_tag(address_t addr, tag_t tag) {
+    if (addr >= size)
+      return false;
+    set(addr >> granularity_shift << granularity_shift, tag);
+    return true;
+  }
+
+  bool store_insn_tag(address_t addr, tag_t tag) {
+    if (addr >= size)
+      return false;
+    set(addr & -(address_t)MIN_TAG_GRANULARITY, tag);
+    return true;
+  }
+
+  bool fill_range(address_t start, address_t end, tag_t tag) {
+    if (start >= end)
+      return true;
+    if (end - MIN_TAG_GRANULARITY >= size)
+      return false;
+    assign(start, end, tag);
+    return true;
+  }
+
+  // as for platform_ram_tag_provider_t, a data tag is the instruction tag of the first word of its
+  // granule and of no other
+  void data_tag_span(address_t addr, address_t& start, address_t& end) {
+    start = addr >> granularity_shift << granularity_shift;
+    end = start + MIN_TAG_GRANULARITY;
+  }
+
+  size_t run_count() const { return runs.size(); }
 };
 
+/**
+ * Dispatches tag lookups to the provider for each address.  Providers are kept in a vector sorted by
+ * start address, and the range of the one that last served a lookup is checked before searching, so
+ * the common case of consecutive accesses to the same region is a compare.  Providers that expose
+ * their tag_storage_t are indexed directly; others are called through tag_provider_t.
+ * As before, an address belongs to the provider with the greatest start address not above it, so a
+ * region nested inside another hides the rest of the outer one above it.
+ */
 class tag_bus_t : public tag_provider_t {
 private:
-  std::map<int64_t, std::unique_ptr<tag_provider_t>> provider_map;
+  struct region_t {
+    address_t start;
+    address_t limit; // end of the addresses dispatched to this region: its end or the next region's start
+    address_t end;
+    tag_storage_t storage;
+    std::unique_ptr<tag_provider_t> provider;
+  };
 
-  decltype(provider_map)::reference get_provider(address_t addr) {
-    if (auto it = provider_map.lower_bound(-addr); it != provider_map.end()) {
-      //return tf(it->second, addr - -it->first);
-      return *it;
-    } else {
-      char buf[64];
-      std::sprintf(buf, "bad address %#lx", addr);
-      throw std::out_of_range(buf);
-    }
+  std::vector<region_t> regions;
+
+  // most providers can't hand out a reference to their tags; use data_tag() and insn_tag() instead
+  using tag_provider_t::data_tag_at;
+  using tag_provider_t::insn_tag_at;
+
+  // the region of the last lookup that found one; size is 0 if there isn't one
+  struct {
+    address_t start = 0;
+    address_t size = 0;
+    tag_storage_t storage;
+    region_t* region = nullptr;
+  } hit;
+
+  region_t* find_region(address_t addr) {
+    if (regions.empty() || addr < regions[0].start)
+      return nullptr;
+    // branch-free search for the last region starting at or below addr; there are only a handful
+    region_t* it = regions.data();
+    for (size_t n = regions.size(); n > 1; n -= n/2)
+      it = it[n/2].start <= addr ? it + n/2 : it;
+    if (addr >= it->limit)
+      return nullptr;
+    hit.start = it->start;
+    hit.size = it->limit - it->start;
+    hit.storage = it->storage;
+    hit.region = it;
+    return it;
+  }
+
+  // Reads the tag for an offset into the hit region from its storage.  Returns false if the region
+  // doesn't expose its storage or keeps this instruction tag apart.
+  template<bool insn>
+  bool load_stored(address_t offset, tag_t& tag) {
+    const tag_storage_t& s = hit.storage;
+    if (!s.pages || (insn && (offset & s.insn_mask)))
+      return false;
+    tag = read_padded_tag(s.pages[offset >> s.page_shift], (offset & s.page_mask) >> s.index_shift, s.width_shift, s.max_tag);
+    return true;
+  }
+
+  // Writes the tag for an offset into the hit region to its storage.  Returns false if the provider
+  // has to do it: the tag is changing in a shared page, or doesn't fit, or load_stored() would fail.
+  template<bool insn>
+  bool store_stored(address_t offset, tag_t tag) {
+    const tag_storage_t& s = hit.storage;
+    if (!s.pages || (insn && (offset & s.insn_mask)))
+      return false;
+    uint8_t* page = s.pages[offset >> s.page_shift];
+    size_t i = (offset & s.page_mask) >> s.index_shift;
+    if (page == s.shared_page || tag > s.max_tag)
+      return read_tag(page, i, s.width_shift) == tag;
+    write_tag(page, i, s.width_shift, tag);
+    return true;
+  }
+
+  // These search for the region and update hit, then fall back on calling the provider.  They
+  // return false if addr isn't mapped.
+  template<bool insn>
+  __attribute__((noinline)) bool find_load(address_t addr, tag_t& tag) {
+    if (addr - hit.start >= hit.size && !find_region(addr))
+      return false;
+    address_t offset = addr - hit.start;
+    if (load_stored<insn>(offset, tag))
+      return true;
+    tag_provider_t* p = hit.region->provider.get();
+    return insn ? p->load_insn_tag(offset, tag) : p->load_data_tag(offset, tag);
+  }
+
+  template<bool insn>
+  __attribute__((noinline)) bool find_store(address_t addr, tag_t tag) {
+    if (addr - hit.start >= hit.size && !find_region(addr))
+      return false;
+    address_t offset = addr - hit.start;
+    if (store_stored<insn>(offset, tag))
+      return true;
+    region_t* r = hit.region;
+    if (!(insn ? r->provider->store_insn_tag(offset, tag) : r->provider->store_data_tag(offset, tag)))
+      return false;
+    // the provider may have copied a page or widened its tags
+    r->storage = r->provider->storage();
+    hit.storage = r->storage;
+    return true;
+  }
+
+  template<bool insn>
+  bool load_tag(address_t addr, tag_t& tag) {
+    address_t offset = addr - hit.start;
+    if (offset < hit.size && load_stored<insn>(offset, tag))
+      return true;
+    return find_load<insn>(addr, tag);
+  }
+
+  template<bool insn>
+  bool store_tag(address_t addr, tag_t tag) {
+    address_t offset = addr - hit.start;
+    if (offset < hit.size && store_stored<insn>(offset, tag))
+      return true;
+    return find_store<insn>(addr, tag);
   }
 
 public:
   void add_provider(address_t start_addr, address_t end_addr, std::unique_ptr<tag_provider_t>&& provider) {
-    provider_map[-start_addr] = std::move(provider);
+    tag_storage_t storage = provider->storage();
+    auto it = std::lower_bound(regions.begin(), regions.end(), start_addr, [](const region_t& r, address_t a) { return r.start < a; });
+    if (it != regions.end() && it->start == start_addr) {
+      it->end = end_addr;
+      it->storage = storage;
+      it->provider = std::move(provider);
+    } else {
+      regions.insert(it, region_t{start_addr, end_addr, end_addr, storage, std::move(provider)});
+    }
+    for (size_t i = 0; i < regions.size(); i++)
+      regions[i].limit = i + 1 < regions.size() ? std::min(regions[i].end, regions[i + 1].start) : regions[i].end;
+    hit = {};
+  }
+
+  // These throw std::out_of_range if nothing is mapped at addr.
+  tag_t data_tag(address_t addr) {
+    tag_t tag;
+    if (!load_data_tag(addr, tag))
+      throw_bad_address(addr);
+    return tag;
   }
 
-  tag_t& data_tag_at(address_t addr) {
-    auto& [ base, tp ] = get_provider(addr);
-    return tp->data_tag_at(addr - -base);
+  tag_t insn_tag(address_t addr) {
+    tag_t tag;
+    if (!load_insn_tag(addr, tag))
+      throw_bad_address(addr);
+    return tag;
   }
 
-  tag_t& insn_tag_at(address_t addr) {
-    auto& [ base, tp ] = get_provider(addr);
-    return tp->insn_tag_at(addr - -base);
+  // These return false, leaving tag unchanged, if nothing is mapped at addr.
+  bool load_data_tag(address_t addr, tag_t& tag) { return load_tag<false>(addr, tag); }
+  bool load_insn_tag(address_t addr, tag_t& tag) { return load_tag<true>(addr, tag); }
+  bool store_data_tag(address_t addr, tag_t tag) { return store_tag<false>(addr, tag); }
+  bool store_insn_tag(address_t addr, tag_t tag) { return store_tag<true>(addr, tag); }
+
+  // The addresses whose instruction tags storing the data tag at addr can change, which can be more
+  // than its granule; an empty span if nothing is mapped at addr.
+  void data_tag_span(address_t addr, address_t& start, address_t& end) {
+    region_t* r = find_region(addr);
+    if (!r) {
+      start = end = addr;
+      return;
+    }
+    r->provider->data_tag_span(addr - r->start, start, end);
+    start = r->start + std::min(start, r->limit - r->start);
+    end = r->start + std::min(end, r->limit - r->start);
+  }
+
+  // Sets the instruction tags of addresses start, start + MIN_TAG_GRANULARITY, ... up to end in
+  // bulk, the same as storing tag to each of them.  Returns false if any of them isn't mapped.
+  bool fill_range(address_t start, address_t end, tag_t tag) {
+    if (start >= end)
+      return true;
+    // only whole words are filled in bulk
+    if (start % MIN_TAG_GRANULARITY != 0) {
+      for (address_t addr = start; addr < end; addr += MIN_TAG_GRANULARITY) {
+        if (!store_insn_tag(addr, tag))
+          return false;
+      }
+      return true;
+    }
+    end = (end + MIN_TAG_GRANULARITY - 1) & -(address_t)MIN_TAG_GRANULARITY;
+    while (start < end) {
+      region_t* r = find_region(start);
+      if (!r)
+        return false;
+      address_t chunk_end = std::min(end, (r->limit + MIN_TAG_GRANULARITY - 1) & -(address_t)MIN_TAG_GRANULARITY);
+      address_t offset = start - r->start;
+      // and the offsets are only whole words if the region starts on one
+      bool filled = offset % MIN_TAG_GRANULARITY == 0 ?
+        r->provider->fill_range(offset, chunk_end - r->start, tag) :
+        r->provider->tag_provider_t::fill_range(offset, chunk_end - r->start, tag);
+      r->storage = r->provider->storage();
+      hit.storage = r->storage;
+      if (!filled)
+        return false;
+      start = chunk_end;
+    }
+    return true;
   }
 };
 
@@ -0,0 +1,165 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#ifndef CODE_TAG_TABLE_H
+#define CODE_TAG_TABLE_H
+
+#include <algorithm>
+#include <vector>
+#include "platform_types.h"
+#include "range.h"
+#include "tag_types.h"
+#include "tag_utils.h"
+
+namespace policy_engine {
+
+/**
+ * Copy of the instruction tags of the program's code, one entry per word in address order, so that
+ * fetching neighbouring instructions reads neighbouring entries instead of going through the tag bus
+ * and sharing cache lines with data tags.  Addresses outside the table aren't found and have to be
+ * looked up on the tag bus.  Stores that change tags in the table have to be reported through
+ * resync().
+ */
+class code_tag_table_t {
+public:
+  // ranges closer together than this share a segment, which takes the tags in between as well
+  static constexpr address_t max_gap = 0x1000;
+
+private:
+  struct segment_t {
+    address_t start;
+    address_t end;
+    tag_array_t tags;
+  };
+
+  std::vector<segment_t> segments; // sorted by address
+  address_t lo = 0; // bounds of all the segments, to turn away data addresses with one compare
+  address_t hi = 0;
+  size_t last = 0;  // segment of the last lookup
+
+  segment_t* find(address_t addr) {
+    if (addr - lo >= hi - lo)
+      return nullptr;
+    if (addr - segments[last].start < segments[last].end - segments[last].start)
+      return &segments[last];
+    auto it = std::upper_bound(segments.begin(), segments.end(), addr, [](address_t a, const segment_t& s) { return a < s.start; });
+    if (it == segments.begin() || addr >= (--it)->end)
+      return nullptr;
+    last = it - segments.begin();
+    return &*it;
+  }
+
+  // Copies the tags of the words from start up to end from tag_bus, splitting the segment around
+  // any words that aren't mapped, such as a gap between two regions of the bus.
+  void add_segment(address_t start, address_t end, tag_bus_t& tag_bus) {
+    std::vector<tag_t> tags;
+    auto finish = [&](address_t next) {
+      if (!tags.empty()) {
+        address_t first = next - tags.size()*MIN_TAG_GRANULARITY;
+        segment_t s{first, next, tag_array_t(tags.size(), tags[0])};
+        for (size_t i = 1; i < tags.size(); i++)
+          s.tags.set(i, tags[i]);
+        segments.push_back(std::move(s));
+        tags.clear();
+      }
+    };
+    for (address_t addr = start; addr < end; addr += MIN_TAG_GRANULARITY) {
+      tag_t tag;
+      if (tag_bus.load_insn_tag(addr, tag))
+        tags.push_back(tag);
+      else
+        finish(addr);
+    }
+    finish(end);
+  }
+
+public:
+  // Adds the words of code to the table, copying their tags from tag_bus.  Anything already in the
+  // table is copied again.
+  void build(const std::vector<range_t>& code, tag_bus_t& tag_bus) {
+    std::vector<range_t> ranges(code);
+    for (const segment_t& s : segments)
+      ranges.push_back(range_t{s.start, s.end});
+    std::sort(ranges.begin(), ranges.end());
+    segments.clear();
+    last = 0;
+    range_t current{0, 0};
+    for (const range_t& r : ranges) {
+      address_t start = r.start & -(address_t)MIN_TAG_GRANULARITY;
+      address_t end = (r.end + MIN_TAG_GRANULARITY - 1) & -(address_t)MIN_TAG_GRANULARITY;
+      if (start >= end)
+        continue;
+      if (current.start < current.end && start <= current.end + max_gap) {
+        current.end = std::max<address_t>(current.end, end);
+      } else {
+        add_segment(current.start, current.end, tag_bus);
+        current = range_t{start, end};
+      }
+    }
+    add_segment(current.start, current.end, tag_bus);
+    lo = segments.empty() ? 0 : segments.front().start;
+    hi = segments.empty() ? 0 : segments.back().end;
+  }
+
+  // Returns false if addr isn't in the table.
+  bool load(address_t addr, tag_t& tag) {
+    segment_t* s = find(addr);
+    if (!s)
+      return false;
+    tag = s->tags[(addr - s->start)/MIN_TAG_GRANULARITY];
+    return true;
+  }
+
+  // Copies the tags of the words from start up to end that are in the table from tag_bus again, such
+  // as the span tag_bus_t::data_tag_span() reports for a store.
+  void resync(address_t start, address_t end, tag_bus_t& tag_bus) {
+    if (start >= hi || end <= lo)
+      return;
+    auto it = std::upper_bound(segments.begin(), segments.end(), start, [](address_t a, const segment_t& s) { return a < s.start; });
+    if (it != segments.begin())
+      --it;
+    for (; it != segments.end() && it->start < end; ++it) {
+      address_t word = std::max(start & -(address_t)MIN_TAG_GRANULARITY, it->start);
+      for (; word < std::min(end, it->end); word += MIN_TAG_GRANULARITY) {
+        tag_t tag;
+        if (tag_bus.load_insn_tag(word, tag))
+          it->tags.set((word - it->start)/MIN_TAG_GRANULARITY, tag);
+      }
+    }
+  }
+
+  // words in the table
+  size_t size() const {
+    size_t n = 0;
+    for (const segment_t& s : segments)
+      n += s.tags.size();
+    return n;
+  }
+};
+
+} // namespace policy_engine
+
+#endif
@@ -0,0 +1,103 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef INSN_CACHE_H
+#define INSN_CACHE_H
+
+#include <cstdint>
+#include <vector>
+#include "platform_types.h"
+#include "riscv_isa.h"
+#include "tag_utils.h"
+
+namespace policy_engine {
+
+/**
+ * Compact form of a decoded instruction along with the tag of the word it was fetched from.  Register
+ * fields are -1 when the instruction doesn't have that operand.
+ */
+struct predecoded_insn_t {
+  address_t pc;     // physical address of the instruction
+  insn_bits_t bits;
+  tag_t ci_tag;
+  int imm;
+  op_t op;
+  int8_t rd;
+  int8_t rs1;
+  int8_t rs2;
+  int8_t rs3;
+  bool has_imm;
+  bool valid;       // only set for instructions that decoded and have a CI tag
+  flags_t flags;
+};
+
+/**
+ * Direct-mapped cache of predecoded instructions indexed by physical PC.  Entries also match on
+ * instruction bits, so rewritten code misses on its own; changes to code tags must be reported through
+ * invalidate() and fence.i or reloading metadata should flush the whole cache.
+ */
+class insn_cache_t {
+private:
+  std::vector<predecoded_insn_t> entries;
+  const address_t mask;
+
+  size_t index(address_t pc) const { return (pc >> 1) & mask; }
+
+public:
+  // size must be a power of two
+  insn_cache_t(size_t size=4096) : entries(size, predecoded_insn_t{}), mask(size - 1) {}
+
+  predecoded_insn_t& slot(address_t pc) { return entries[index(pc)]; }
+
+  const predecoded_insn_t* lookup(address_t pc, insn_bits_t bits) const {
+    const predecoded_insn_t& entry = entries[index(pc)];
+    if (entry.valid && entry.pc == pc && entry.bits == bits)
+      return &entry;
+    return nullptr;
+  }
+
+  // Drops any instruction that took its CI tag from the addresses from start up to end, which flushes
+  // the whole cache if they cover more than it does.  Instructions are 2-byte aligned.
+  void invalidate(address_t start, address_t end) {
+    if (end - start >= 2*entries.size()) {
+      flush();
+      return;
+    }
+    for (address_t pc = start & ~(address_t)1; pc < end; pc += 2) {
+      predecoded_insn_t& entry = entries[index(pc)];
+      if (entry.pc == pc)
+        entry.valid = false;
+    }
+  }
+
+  void flush() {
+    for (predecoded_insn_t& entry : entries)
+      entry.valid = false;
+  }
+};
+
+} // namespace policy_engine
+
+#endif
@@ -24,10 +24,12 @@
  * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
  */
 
+#include <algorithm>
+#include <array>
 #include <cstdint>
 #include <stdexcept>
-#include <string>
-#include <unordered_map>
+#include <type_traits>
+#include <vector>
 #include "inst_decoder.h"
 #include "option.h"
 #include "platform_types.h"
@@ -40,7 +42,36 @@ static constexpr int x1 = 1;
 static constexpr int x2 = 2;
 static const decoded_instruction_t invalid_inst{.name="", .op=RISCV_INVALID};
 
-static decoded_instruction_t r_type_inst(const std::string& name, op_t op, int rd, int rs1, int rs2, flags_t flags=flags_t{}) { return decoded_instruction_t{
+static const char* const op_names[] = {
+  "", "beq", "bne", "blt", "bge", "bltu", "bgeu", "jalr", "jal", "lui", "auipc", "addi", "slli",
+  "slti", "sltiu", "xori", "srli", "srai", "ori", "andi", "add", "sub", "sll", "slt", "sltu",
+  "xor", "srl", "sra", "or", "and", "addiw", "slliw", "srliw", "sraiw", "addw", "subw", "sllw",
+  "srlw", "sraw", "lb", "lh", "lw", "ld", "lbu", "lhu", "lwu", "sb", "sh", "sw", "sd", "fence",
+  "fence.i", "mul", "mulh", "mulhsu", "mulhu", "div", "divu", "rem", "remu", "amoadd.w",
+  "amoxor.w", "amoor.w", "amoand.w", "amomin.w", "amomax.w", "amominu.w", "amomaxu.w", "amoswap.w",
+  "lr.w", "sc.w", "amoadd.d", "amoxor.d", "amoor.d", "amoand.d", "amomin.d", "amomax.d",
+  "amominu.d", "amomaxu.d", "amoswap.d", "lr.d", "sc.d", "ecall", "ebreak", "uret", "sret", "mret",
+  "dret", "sfence.vma", "wfi", "csrrw", "csrrs", "csrrc", "csrrwi", "csrrsi", "csrrci", "fadd.s",
+  "fsub.s", "fmul.s", "fdiv.s", "fsgnj.s", "fsgnjn.s", "fsgnjx.s", "fmin.s", "fmax.s", "fsqrt.s",
+  "fadd.d", "fsub.d", "fmul.d", "fdiv.d", "fsgnj.d", "fsgnjn.d", "fsgnjx.d", "fmin.d", "fmax.d",
+  "fcvt.s.d", "fcvt.d.s", "fsqrt.d", "fadd.q", "fsub.q", "fmul.q", "fdiv.q", "fsgnj.q", "fsgnjn.q",
+  "fsgnjx.q", "fmin.q", "fmax.q", "fcvt.s.q", "fcvt.q.s", "fcvt.d.q", "fcvt.q.d", "fsqrt.q",
+  "fle.s", "flt.s", "feq.s", "fle.d", "flt.d", "feq.d", "fle.q", "flt.q", "feq.q", "fcvt.w.s",
+  "fcvt.wu.s", "fcvt.l.s", "fcvt.lu.s", "fmv.x.w", "fclass.s", "fcvt.w.d", "fcvt.wu.d", "fcvt.l.d",
+  "fcvt.lu.d", "fmv.x.d", "fclass.d", "fcvt.w.q", "fcvt.wu.q", "fcvt.l.q", "fcvt.lu.q", "fmv.x.q",
+  "fclass.q", "fcvt.s.w", "fcvt.s.wu", "fcvt.s.l", "fcvt.s.lu", "fmv.w.x", "fcvt.d.w", "fcvt.d.wu",
+  "fcvt.d.l", "fcvt.d.lu", "fmv.d.x", "fcvt.q.w", "fcvt.q.wu", "fcvt.q.l", "fcvt.q.lu", "fmv.q.x",
+  "flw", "fld", "flq", "fsw", "fsd", "fsq", "fmadd.s", "fmsub.s", "fnmsub.s", "fnmadd.s",
+  "fmadd.d", "fmsub.d", "fnmsub.d", "fnmadd.d", "fmadd.q", "fmsub.q", "fnmsub.q", "fnmadd.q",
+  "mulw", "remw", "divw", "divuw", "remuw"
+};
+static_assert(sizeof(op_names)/sizeof(op_names[0]) == RISCV_REMUW + 1, "op_names must cover every op_t");
+
+const char* op_name(op_t op) { return op_names[op]; }
+
+static_assert(std::is_trivially_copyable<decoded_instruction_t>::value, "decoding must not allocate");
+
+static decoded_instruction_t r_type_inst(const char* name, op_t op, int rd, int rs1, int rs2, flags_t flags=flags_t{}) { return decoded_instruction_t{
   .name=name,
   .op=op,
   .rd=rd,
@@ -51,7 +82,7 @@ static decoded_instruction_t r_type_inst(const std::string& name, op_t op, int r
   .flags=flags
 }; }
 
-static decoded_instruction_t r4_type_inst(const std::string& name, op_t op, int rd, int rs1, int rs2, int rs3, flags_t flags=flags_t{}) { return decoded_instruction_t {
+static decoded_instruction_t r4_type_inst(const char* name, op_t op, int rd, int rs1, int rs2, int rs3, flags_t flags=flags_t{}) { return decoded_instruction_t {
   .name=name,
   .op=op,
   .rd=rd,
@@ -62,7 +93,7 @@ static decoded_instruction_t r4_type_inst(const std::string& name, op_t op, int
   .flags=flags
 }; }
 
-static decoded_instruction_t fp_conv_inst(const std::string& name, op_t op, int rd, int rs1, flags_t flags=flags_t{}) { return decoded_instruction_t{
+static decoded_instruction_t fp_conv_inst(const char* name, op_t op, int rd, int rs1, flags_t flags=flags_t{}) { return decoded_instruction_t{
   .name=name,
   .op=op,
   .rd=rd,
@@ -73,7 +104,7 @@ static decoded_instruction_t fp_conv_inst(const std::string& name, op_t op, int
   .flags=flags
 }; }
 
-static decoded_instruction_t i_type_inst(const std::string& name, op_t op, int rd, int rs1, int imm, flags_t flags=flags_t{}) { return decoded_instruction_t{
+static decoded_instruction_t i_type_inst(const char* name, op_t op, int rd, int rs1, int imm, flags_t flags=flags_t{}) { return decoded_instruction_t{
   .name=name,
   .op=op,
   .rd=rd,
@@ -84,7 +115,7 @@ static decoded_instruction_t i_type_inst(const std::string& name, op_t op, int r
   .flags=flags
 }; }
 
-static decoded_instruction_t csr_inst(const std::string& name, op_t op, int rd, int rs1, uint16_t csr) { return decoded_instruction_t{
+static decoded_instruction_t csr_inst(const char* name, op_t op, int rd, int rs1, uint16_t csr) { return decoded_instruction_t{
   .name=name,
   .op=op,
   .rd=when(rd != 0, rd),
@@ -95,7 +126,7 @@ static decoded_instruction_t csr_inst(const std::string& name, op_t op, int rd,
   .flags=(rd != 0 ? (has_csr_load | has_csr_store) : has_csr_store)
 }; }
 
-static decoded_instruction_t s_type_inst(const std::string& name, op_t op, int rs1, int rs2, int imm, flags_t flags=flags_t{}) { return decoded_instruction_t{
+static decoded_instruction_t s_type_inst(const char* name, op_t op, int rs1, int rs2, int imm, flags_t flags=flags_t{}) { return decoded_instruction_t{
   .name=name,
   .op=op,
   .rd=none<int>(),
@@ -106,7 +137,7 @@ static decoded_instruction_t s_type_inst(const std::string& name, op_t op, int r
   .flags=flags
 }; }
 
-static decoded_instruction_t u_type_inst(const std::string& name, op_t op, int rd, int imm, flags_t flags=flags_t{}) { return decoded_instruction_t {
+static decoded_instruction_t u_type_inst(const char* name, op_t op, int rd, int imm, flags_t flags=flags_t{}) { return decoded_instruction_t {
   .name=name,
   .op=op,
   .rd=rd,
@@ -117,7 +148,7 @@ static decoded_instruction_t u_type_inst(const std::string& name, op_t op, int r
   .flags=flags
 }; }
 
-static decoded_instruction_t system_inst(const std::string& name, op_t op, flags_t flags=flags_t{}) { return decoded_instruction_t {
+static decoded_instruction_t system_inst(const char* name, op_t op, flags_t flags=flags_t{}) { return decoded_instruction_t {
   .name=name,
   .op=op,
   .rd=none<int>(),
@@ -789,12 +820,18 @@ static decoded_instruction_t decode_ca_type(int xlen, uint8_t quad, uint8_t f6,
   }
 }
 
-decoded_instruction_t decode(insn_bits_t bits, int xlen) {
-  if (xlen != 32 && xlen != 64) {
-    throw std::invalid_argument("only RV32 and RV64 are supported");
-  }
+// Formats whose decoders may accept an instruction, in the order the reference decoder tries them
+enum format_mask_t : uint8_t {
+  R_FORMAT = 0x01,
+  I_FORMAT = 0x02,
+  S_FORMAT = 0x04,
+  U_FORMAT = 0x08,
+  FP_FORMAT = 0x10,
+  SYSTEM_FORMAT = 0x20,
+  ALL_FORMATS = 0x3f
+};
 
-  // full instructions
+static decoded_instruction_t decode_full(insn_bits_t bits, uint8_t formats) {
   uint8_t opcode = bits & 0x7f;
   uint8_t f3 = (bits & 0x7000) >> 12;
   uint8_t f7 = (bits & 0xfe000000) >> 25;
@@ -805,21 +842,30 @@ decoded_instruction_t decode(insn_bits_t bits, int xlen) {
   int s_imm = (static_cast<int>(bits & 0xfe000000) >> 20) | rd;
   int u_imm = static_cast<int>(bits) & ~0xfff;
 
-  if (decoded_instruction_t r = decode_r_type(opcode, f3, f7, rd, rs1, rs2))
-    return r;
-  if (decoded_instruction_t i = decode_i_type(opcode, f3, rd, rs1, i_imm))
-    return i;
-  if (decoded_instruction_t s = decode_s_type(opcode, f3, rs1, rs2, s_imm))
-    return s;
-  if (decoded_instruction_t u = decode_u_type(opcode, rd, u_imm))
-    return u;
-  if (decoded_instruction_t fp = decode_fp(opcode, f7, f3, rd, rs1, rs2))
-    return fp;
-  if (decoded_instruction_t sys = decode_system(opcode, f7, f3, rs1, rs2))
-    return sys;
-
-  // compressed instructions
+  if (formats & R_FORMAT)
+    if (decoded_instruction_t r = decode_r_type(opcode, f3, f7, rd, rs1, rs2))
+      return r;
+  if (formats & I_FORMAT)
+    if (decoded_instruction_t i = decode_i_type(opcode, f3, rd, rs1, i_imm))
+      return i;
+  if (formats & S_FORMAT)
+    if (decoded_instruction_t s = decode_s_type(opcode, f3, rs1, rs2, s_imm))
+      return s;
+  if (formats & U_FORMAT)
+    if (decoded_instruction_t u = decode_u_type(opcode, rd, u_imm))
+      return u;
+  if (formats & FP_FORMAT)
+    if (decoded_instruction_t fp = decode_fp(opcode, f7, f3, rd, rs1, rs2))
+      return fp;
+  if (formats & SYSTEM_FORMAT)
+    if (decoded_instruction_t sys = decode_system(opcode, f7, f3, rs1, rs2))
+      return sys;
+  return invalid_inst;
+}
+
+static decoded_instruction_t decode_compressed(insn_bits_t bits, int xlen) {
   uint8_t quad = bits & 0x3;
+  int rd = (bits & 0xf80) >> 7;
   uint8_t c_f2 = (bits & 0x60) >> 5;
   uint8_t c_f3 = (bits & 0xe000) >> 13;
   uint8_t c_f4 = (bits & 0xf000) >> 12;
@@ -855,4 +901,127 @@ decoded_instruction_t decode(insn_bits_t bits, int xlen) {
   return invalid_inst;
 }
 
+// Maps a major opcode to the decoders that handle it.  Every 32-bit opcode has its low two bits set,
+// so the other three quarters of the table are empty.
+static constexpr std::array<uint8_t, 0x80> make_opcode_formats() {
+  std::array<uint8_t, 0x80> formats{};
+  for (uint8_t op : {0x2f, 0x33, 0x3b})
+    formats[op] = R_FORMAT;
+  for (uint8_t op : {0x03, 0x07, 0x13, 0x1b, 0x67})
+    formats[op] = I_FORMAT;
+  for (uint8_t op : {0x23, 0x27, 0x63})
+    formats[op] = S_FORMAT;
+  for (uint8_t op : {0x17, 0x37, 0x6f})
+    formats[op] = U_FORMAT;
+  for (uint8_t op : {0x43, 0x47, 0x4b, 0x4f, 0x53})
+    formats[op] = FP_FORMAT;
+  formats[0x0f] = SYSTEM_FORMAT;
+  formats[0x73] = I_FORMAT | SYSTEM_FORMAT; // CSR accesses first, then the rest of SYSTEM
+  return formats;
+}
+
+static constexpr std::array<uint8_t, 0x80> opcode_formats = make_opcode_formats();
+
+/**
+ * Every 16-bit encoding predecoded by the reference compressed decoder, so the table always agrees
+ * with it.  Entries are packed to keep the table at 768KiB, and only the table for the XLEN being
+ * decoded is built.
+ */
+class compressed_table_t {
+private:
+  struct entry_t {
+    uint8_t name;  // index into names
+    uint8_t op;
+    int8_t rd;     // registers are -1 if not present
+    int8_t rs1;
+    int8_t rs2;
+    int8_t rs3;
+    uint8_t flags; // flags_t packed as bits
+    bool has_imm;
+    int32_t imm;
+  };
+
+  std::vector<const char*> names;
+  std::vector<entry_t> entries;
+
+  static int8_t pack(const option<int>& reg) { return reg.exists ? reg.get() : -1; }
+  static option<int> unpack(int8_t reg) { return reg >= 0 ? some<int>(reg) : none<int>(); }
+
+public:
+  compressed_table_t(int xlen) : names{""}, entries(0x10000) {
+    for (insn_bits_t bits = 0; bits < 0x10000; bits++) {
+      decoded_instruction_t inst = decode_compressed(bits, xlen);
+      if (!inst) {
+        entries[bits] = entry_t{.name=0, .op=RISCV_INVALID, .rd=-1, .rs1=-1, .rs2=-1, .rs3=-1, .flags=0, .has_imm=false, .imm=0};
+        continue;
+      }
+      size_t name = std::find(names.begin(), names.end(), inst.name) - names.begin();
+      if (name == names.size())
+        names.push_back(inst.name);
+      entries[bits] = entry_t{
+        .name=static_cast<uint8_t>(name),
+        .op=static_cast<uint8_t>(inst.op),
+        .rd=pack(inst.rd),
+        .rs1=pack(inst.rs1),
+        .rs2=pack(inst.rs2),
+        .rs3=pack(inst.rs3),
+        .flags=static_cast<uint8_t>(inst.flags.has_load | inst.flags.has_store << 1 | inst.flags.has_csr_load << 2 | inst.flags.has_csr_store << 3 | inst.flags.is_compressed << 4),
+        .has_imm=inst.imm.exists,
+        .imm=inst.imm.getOrElse(0)
+      };
+    }
+  }
+
+  decoded_instruction_t operator [](insn_bits_t bits) const {
+    const entry_t& e = entries[bits & 0xffff];
+    if (e.op == RISCV_INVALID)
+      return invalid_inst;
+    return decoded_instruction_t{
+      .name=names[e.name],
+      .op=static_cast<op_t>(e.op),
+      .rd=unpack(e.rd),
+      .rs1=unpack(e.rs1),
+      .rs2=unpack(e.rs2),
+      .rs3=unpack(e.rs3),
+      .imm=e.has_imm ? some<int>(e.imm) : none<int>(),
+      .flags=flags_t{
+        .has_load=(e.flags & 0x1) != 0,
+        .has_store=(e.flags & 0x2) != 0,
+        .has_csr_load=(e.flags & 0x4) != 0,
+        .has_csr_store=(e.flags & 0x8) != 0,
+        .is_compressed=(e.flags & 0x10) != 0
+      }
+    };
+  }
+};
+
+static_assert(RISCV_REMUW <= UINT8_MAX, "compressed table packs op_t into a byte");
+
+// Each table is built the first time an instruction of its XLEN is decoded.
+static const compressed_table_t& compressed_table(int xlen) {
+  if (xlen == 32) {
+    static const compressed_table_t rv32(32);
+    return rv32;
+  }
+  static const compressed_table_t rv64(64);
+  return rv64;
+}
+
+decoded_instruction_t decode(insn_bits_t bits, int xlen, decoder_mode_t mode) {
+  if (xlen != 32 && xlen != 64) {
+    throw std::invalid_argument("only RV32 and RV64 are supported");
+  }
+
+  if (mode == DECODER_REFERENCE) {
+    if (decoded_instruction_t full = decode_full(bits, ALL_FORMATS))
+      return full;
+    return decode_compressed(bits, xlen);
+  }
+
+  // the compressed decoders reject quadrant 3 and the full decoders reject everything else
+  if ((bits & 0x3) != 0x3)
+    return compressed_table(xlen)[bits];
+  return decode_full(bits, opcode_formats[bits & 0x7f]);
+}
+
 } // namespace policy_engine
\ No newline at end of file
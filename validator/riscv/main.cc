@@ -25,19 +25,23 @@
  */
 
 #include <cinttypes>
+#include <cstddef>
 #include <cstdint>
 #include <cstdio>
 #include <cstring>
 #include <limits>
 #include <memory>
 #include <string>
+#include <vector>
 #include <yaml-cpp/yaml.h>
+#include "elf_loader.h"
 #include "meta_cache.h"
 #include "metadata_memory_map.h"
 #include "meta_set_factory.h"
 #include "platform_types.h"
 #include "policy_meta_set.h"
 #include "policy_utils.h"
+#include "qemu_interface.h"
 #include "rv_validator.h"
 #include "tag_file.h"
 #include "tag_utils.h"
@@ -47,6 +51,7 @@ static std::unique_ptr<policy_engine::rv_validator_t> rv_validator = nullptr;
 static std::string policy_dir;
 static std::string tags_file;
 static std::string soc_cfg_path;
+static std::string elf_file;
 static std::string rule_cache_name;
 static int rule_cache_capacity;
 
@@ -54,20 +59,6 @@ static bool DOA = false;
 
 extern "C" {
 
-tag_t canonize(const meta_set_t* ts) {
-  if (rv_validator)
-    return rv_validator->ms_cache.canonize(*ts);
-  else
-    return BAD_TAG_VALUE;
-}
-
-const meta_set_t* get_ms(tag_t tag) {
-  if (tag != BAD_TAG_VALUE)
-    return &rv_validator->ms_cache[tag];
-  else
-    return nullptr;
-}
-
 void e_v_set_callbacks(RegisterReader_t reg_reader, MemoryReader_t mem_reader, AddressFixer_t addr_fixer) {
   if (!DOA) {
     try {
@@ -80,7 +71,10 @@ void e_v_set_callbacks(RegisterReader_t reg_reader, MemoryReader_t mem_reader, A
       if (!loaded) {
         std::printf("failed read\n");
       } else {
-        rv_validator->apply_metadata(&map);
+        std::vector<policy_engine::range_t> code;
+        if (!elf_file.empty())
+          code = policy_engine::elf_image_t(elf_file).code_ranges();
+        rv_validator->apply_metadata(&map, code);
       }
       if (rule_cache_name.size() != 0)
         rv_validator->config_rule_cache(rule_cache_name, rule_cache_capacity);
@@ -118,6 +112,8 @@ void e_v_set_metadata(const char* validator_cfg_path) {
     } else {
       throw policy_engine::configuration_exception_t("Must provide soc_cfg file path in validator yaml configuration");
     }
+    if (cfg["elf_file"])
+      elf_file = cfg["elf_file"].as<std::string>();
     if (cfg["rule_cache"]) {
       for (const auto& element: cfg["rule_cache"]) {
         std::string element_string = element.first.as<std::string>();
@@ -167,6 +163,67 @@ uint32_t e_v_validate_cached(uint64_t pc, uint32_t instr, uint64_t mem_addr, boo
   return 0;
 }
 
+uint32_t e_v_step(uint64_t pc, uint32_t instr, uint64_t mem_addr, uint32_t* flags) {
+  *flags = 0;
+  if (DOA)
+    return 0;
+  if (pc > rv_validator->address_max() || mem_addr > rv_validator->address_max()) {
+    std::printf("Step PC (0x%lx) or Mem Address (0x%lx) Out of Range.\n", pc, mem_addr);
+    DOA = true;
+    return 0;
+  }
+
+  try {
+    auto [ success, hit ] = rv_validator->validate(static_cast<address_t>(pc), instr, static_cast<address_t>(mem_addr));
+    if (hit)
+      *flags |= E_V_STEP_RULE_CACHE_HIT;
+    if (!success) {
+      *flags |= E_V_STEP_VIOLATION;
+      return 0;
+    }
+    if (rv_validator->commit())
+      *flags |= E_V_STEP_WATCH;
+    return 1;
+  } catch (...) {
+    std::printf("c++ exception while stepping - policy code DOA\n");
+    DOA = true;
+  }
+  return 0;
+}
+
+static_assert(sizeof(e_v_trace_record_t) == sizeof(policy_engine::trace_record_t) &&
+              offsetof(e_v_trace_record_t, pc) == offsetof(policy_engine::trace_record_t, pc) &&
+              offsetof(e_v_trace_record_t, mem_addr) == offsetof(policy_engine::trace_record_t, mem_addr) &&
+              offsetof(e_v_trace_record_t, instr) == offsetof(policy_engine::trace_record_t, insn),
+              "e_v_trace_record_t must match trace_record_t");
+
+uint64_t e_v_validate_batch(const e_v_trace_record_t* records, const uint64_t* rs1_values, uint64_t n, uint32_t* flags) {
+  *flags = 0;
+  if (DOA)
+    return 0;
+  for (uint64_t i = 0; i < n; i++) {
+    if (records[i].pc > rv_validator->address_max() || (!rs1_values && records[i].mem_addr > rv_validator->address_max())) {
+      std::printf("Batch PC (0x%lx) or Mem Address (0x%lx) Out of Range.\n", records[i].pc, records[i].mem_addr);
+      DOA = true;
+      return 0;
+    }
+  }
+
+  try {
+    bool hit_watch;
+    size_t stop = rv_validator->validate_batch(reinterpret_cast<const policy_engine::trace_record_t*>(records), rs1_values, n, hit_watch);
+    if (hit_watch)
+      *flags |= E_V_STEP_WATCH;
+    else if (stop < n)
+      *flags |= E_V_STEP_VIOLATION;
+    return stop;
+  } catch (...) {
+    std::printf("c++ exception while validating batch - policy code DOA\n");
+    DOA = true;
+  }
+  return 0;
+}
+
 uint32_t e_v_commit() {
   if (!DOA) {
     try {
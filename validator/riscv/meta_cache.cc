@@ -1,4 +1,4 @@
-#include <iostream>
+#include <cstdint>
 #include "meta_cache.h"
 #include "metadata.h"
 #include "policy_meta_set.h"
@@ -15,14 +15,18 @@ bool operator ==(const meta_set_t& lhs, const meta_set_t& rhs) {
 
 bool operator !=(const meta_set_t& lhs, const meta_set_t& rhs) { return !(lhs == rhs); }
 
+size_t meta_set_hash_t::operator ()(const meta_set_t& ms) const {
+  uint64_t h = 0;
+  for (int i = 0; i < META_SET_WORDS; i++)
+    h = (h ^ ms.tags[i]) * 0x9e3779b97f4a7c15ULL;
+  return h ^ (h >> 32);
+}
+
 tag_t meta_set_cache_t::canonize(const meta_set_t& ts) {
-  for (int i = 0; i < meta_sets.size(); i++)
-    if (meta_sets[i] == ts)
-      return i + 1;
-  if (meta_sets.size() == meta_sets.capacity())
-    std::cout << "reallocating meta set vector to increase capacity may invalidate tags that are pointers" << std::endl;
-  meta_sets.push_back(ts);
-  return meta_sets.size();
+  auto [ it, inserted ] = tags.try_emplace(ts, meta_sets.size() + 1);
+  if (inserted)
+    meta_sets.push_back(ts);
+  return it->second;
 }
 
 tag_t meta_set_cache_t::canonize(const metadata_t& md) {
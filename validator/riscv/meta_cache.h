@@ -27,7 +27,9 @@
 #ifndef META_CACHE_H
 #define META_CACHE_H
 
-#include <vector>
+#include <cstddef>
+#include <deque>
+#include <unordered_map>
 #include "metadata.h"
 #include "policy_meta_set.h"
 #include "tag_utils.h"
@@ -37,16 +39,29 @@ namespace policy_engine {
 bool operator ==(const meta_set_t& lhs, const meta_set_t& rhs);
 bool operator !=(const meta_set_t& lhs, const meta_set_t& rhs);
 
+struct meta_set_hash_t {
+  size_t operator ()(const meta_set_t& ms) const;
+};
+
+struct meta_set_equal_t {
+  bool operator ()(const meta_set_t& lhs, const meta_set_t& rhs) const { return lhs == rhs; }
+};
+
 class meta_set_cache_t {
 private:
-  std::vector<meta_set_t> meta_sets;
+  // meta sets are stored in a deque so that references handed out to policy code never move
+  // when the cache grows; the index map turns canonization into a single hash lookup
+  std::deque<meta_set_t> meta_sets;
+  std::unordered_map<meta_set_t, tag_t, meta_set_hash_t, meta_set_equal_t> tags;
 
 public:
-  meta_set_cache_t() { meta_sets.reserve(1024); }
+  meta_set_cache_t() { tags.reserve(1024); }
 
   tag_t canonize(const meta_set_t& ts);
   tag_t canonize(const metadata_t& md);
 
+  size_t size() const { return meta_sets.size(); }
+
   const meta_set_t& operator [](tag_t tag) const { return meta_sets.at(tag - 1); }
 };
 
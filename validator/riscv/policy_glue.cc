@@ -0,0 +1,56 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+
+#include "policy_meta_set.h"
+#include "policy_utils.h"
+#include "rv_validator.h"
+
+namespace policy_engine {
+
+rv_validator_t* policy_validator = nullptr;
+
+} // namespace policy_engine
+
+using policy_engine::policy_validator;
+
+extern "C" {
+
+// called by policy code to intern the meta sets it creates and to look them up again by tag
+tag_t canonize(const meta_set_t* ts) {
+  if (policy_validator)
+    return policy_validator->ms_cache.canonize(*ts);
+  else
+    return BAD_TAG_VALUE;
+}
+
+const meta_set_t* get_ms(tag_t tag) {
+  if (tag != BAD_TAG_VALUE)
+    return &policy_validator->ms_cache[tag];
+  else
+    return nullptr;
+}
+
+}
@@ -48,34 +48,37 @@ static std::string tag_name(const meta_set_t* tag) {
 }
 
 rv_validator_t::rv_validator_t(int xlen, const std::string& policy_dir, const std::string& soc_cfg, RegisterReader_t rr, AddressFixer_t af) :
-    sim_validator_t(rr, af), tag_based_validator_t(policy_dir), res({BAD_TAG_VALUE, BAD_TAG_VALUE, BAD_TAG_VALUE, true, true, true}),
-    xlen(xlen), watch_pc(false), rule_cache(nullptr), failed(false), has_insn_mem_addr(false), rule_cache_hits(0), rule_cache_misses(0) {
-  ireg_tags.fill(ms_factory.get_tag("ISA.RISCV.Reg.Default"));
-  if (ms_factory.has_meta_set("ISA.RISCV.Reg.RZero"))
-    ireg_tags[0] = ms_factory.get_tag("ISA.RISCV.Reg.RZero");
-  csr_tags.fill(ms_factory.get_tag("ISA.RISCV.CSR.Default"));
+    sim_validator_t(rr, af), tag_based_validator_t(policy_dir), has_insn_mem_addr(false), has_rs1_value(false), empty_tag(BAD_TAG_VALUE),
+    xlen(xlen), res({BAD_TAG_VALUE, BAD_TAG_VALUE, BAD_TAG_VALUE, true, true, true}), policy_evaluator(eval_policy), watch_pc(false), has_watches(false),
+    failed(false), rule_cache(nullptr), rule_cache_hits(0), rule_cache_misses(0) {
+  tag_t reg_tag = ms_factory.get_tag("ISA.RISCV.Reg.Default");
+  tag_t zero_tag = ms_factory.has_meta_set("ISA.RISCV.Reg.RZero") ? ms_factory.get_tag("ISA.RISCV.Reg.RZero") : reg_tag;
+  tag_t csr_tag = ms_factory.get_tag("ISA.RISCV.CSR.Default");
   pc_tag = ms_factory.get_tag("ISA.RISCV.Reg.Env");
 
   soc_tag_configuration_t config(&ms_factory, soc_cfg, xlen);
+  ireg_tags = tag_array_t(32, reg_tag, config.get_tag_width());
+  ireg_tags.set(0, zero_tag);
+  csr_tags = tag_array_t(0x1000, csr_tag, config.get_tag_width());
   config.apply(&tag_bus, &ms_cache);
+  policy_validator = this;
 }
 
 rv_validator_t::~rv_validator_t() {
+  if (policy_validator == this)
+    policy_validator = nullptr;
   if (rule_cache) {
     delete rule_cache;
   }
 }
 
-void rv_validator_t::apply_metadata(const metadata_memory_map_t* md_map) {
+void rv_validator_t::apply_metadata(const metadata_memory_map_t* md_map, const std::vector<range_t>& code) {
   for (const auto [ range, metadata ] : *md_map) {
-    for (address_t start = range.start; start < range.end; start += 4) {
-      try {
-        tag_bus.insn_tag_at(start) = ms_cache.canonize(*metadata);
-      } catch (const std::out_of_range& e) {
-        throw configuration_exception_t("unable to apply metadata");
-      }
-    }
+    if (range.start < range.end && !tag_bus.fill_range(range.start, range.end, ms_cache.canonize(*metadata)))
+      throw configuration_exception_t("unable to apply metadata");
   }
+  code_tags.build(code, tag_bus);
+  insn_cache.flush();
 }
 
 void rv_validator_t::handle_violation(context_t* ctx, const operands_t* ops){
@@ -87,11 +90,14 @@ void rv_validator_t::handle_violation(context_t* ctx, const operands_t* ops){
 }
 
 void rv_validator_t::setup_validation() {
-  meta_set_t empty{0};
+  if (empty_tag == BAD_TAG_VALUE) {
+    meta_set_t empty{0};
+    empty_tag = ms_cache.canonize(empty);
+  }
 
   ctx = {0, 0, 0, "", "", true};
   ops = {BAD_TAG_VALUE, BAD_TAG_VALUE, BAD_TAG_VALUE, BAD_TAG_VALUE, BAD_TAG_VALUE, BAD_TAG_VALUE};
-  res = {ms_cache.canonize(empty), ms_cache.canonize(empty), ms_cache.canonize(empty), false, false, false};
+  res = {empty_tag, empty_tag, empty_tag, false, false, false};
 }
 
 std::pair<bool, bool> rv_validator_t::validate(address_t pc, insn_bits_t insn, address_t memory_addr) {
@@ -99,13 +105,7 @@ std::pair<bool, bool> rv_validator_t::validate(address_t pc, insn_bits_t insn, a
   mem_addr = memory_addr;
 
   bool result = validate(pc, insn);
-  if (rule_cache) {
-    if (rule_cache_hit)
-      rule_cache_hits++;
-    else
-      rule_cache_misses++;
-  }
-  return std::make_pair(result, rule_cache_hit);
+  return std::make_pair(result, rule_cache != nullptr && rule_cache_hit);
 }
 
 void rv_validator_t::flush_rule_cache() {
@@ -119,7 +119,7 @@ bool rv_validator_t::validate(address_t pc, insn_bits_t insn) {
   setup_validation();
   prepare_eval(pc, insn);
   if (rule_cache) {
-    if (rule_cache->allow(ops, res)) {
+    if (rule_cache->probe(ops, res, rule_cache_hint)) {
       rule_cache_hits++;
       rule_cache_hit = true;
       return true;
@@ -129,7 +129,7 @@ bool rv_validator_t::validate(address_t pc, insn_bits_t insn) {
     }
   }
 
-  policy_result = eval_policy(&ctx, &ops, &res);
+  policy_result = policy_evaluator(&ctx, &ops, &res);
   ctx.policy_result = policy_result;
   if (policy_result == POLICY_SUCCESS) {
     complete_eval();
@@ -140,11 +140,31 @@ bool rv_validator_t::validate(address_t pc, insn_bits_t insn) {
   return policy_result == POLICY_SUCCESS;
 }
 
+size_t rv_validator_t::validate_batch(const trace_record_t* records, const reg_t* rs1_values, size_t n, bool& hit_watch) {
+  hit_watch = false;
+  for (size_t i = 0; i < n; i++) {
+    if (rs1_values) {
+      has_rs1_value = true;
+      rs1_value = rs1_values[i];
+    } else {
+      has_insn_mem_addr = true;
+      mem_addr = records[i].mem_addr;
+    }
+    if (!validate(records[i].pc, records[i].insn))
+      return i;
+    if (commit()) {
+      hit_watch = true;
+      return i;
+    }
+  }
+  return n;
+}
+
 bool rv_validator_t::commit() {
   bool hit_watch = false;
 
   if (res.pcResult) {
-    if (watch_pc && pc_tag != res.pc) {
+    if (has_watches && watch_pc && pc_tag != res.pc) {
       std::cout << "Watch tag pc" << std::endl;
       hit_watch = true;
     }
@@ -152,39 +172,48 @@ bool rv_validator_t::commit() {
   }
 
   if (has_pending_RD && res.rdResult) {
-    for (const address_t& reg : watch_regs) {
-      if (pending_RD == reg && ireg_tags[pending_RD] != res.rd) {
-        std::cout << "Watch tag reg" << std::endl;
-        hit_watch = true;
+    if (has_watches) {
+      for (const address_t& reg : watch_regs) {
+        if (pending_RD == reg && ireg_tags[pending_RD] != res.rd) {
+          std::cout << "Watch tag reg" << std::endl;
+          hit_watch = true;
+        }
       }
     }
 
     // dont update metadata on regZero
     if (pending_RD)
-        ireg_tags[pending_RD] = res.rd;
+        ireg_tags.set(pending_RD, res.rd);
   }
   
   if (has_pending_mem && res.rdResult) {
-    tag_t old_tag;
+    tag_t old_tag = BAD_TAG_VALUE;
     address_t mem_paddr = addr_fixer(mem_addr);
-    try {
-      old_tag = tag_bus.data_tag_at(mem_paddr);
-    } catch (const std::out_of_range& e) {
+    if (!tag_bus.load_data_tag(mem_paddr, old_tag)) {
       std::printf("failed to load MR tag @ 0x%" PRIaddr " (0x%" PRIaddr ")\n", mem_addr, mem_paddr);
       hit_watch = true; // might as well halt
     }
 
-    for (const address_t& addr : watch_addrs) {
-      if (mem_addr == addr && old_tag != res.rd){
-        address_t epc_addr = ctx.epc;
-        std::printf("Watch tag mem at PC 0x%" PRIaddr "\n", epc_addr);
-        hit_watch = true;
+    if (has_watches) {
+      for (const address_t& addr : watch_addrs) {
+        if (mem_addr == addr && old_tag != res.rd){
+          address_t epc_addr = ctx.epc;
+          std::printf("Watch tag mem at PC 0x%" PRIaddr "\n", epc_addr);
+          hit_watch = true;
+        }
       }
     }
 
-    try {
-      tag_bus.data_tag_at(mem_paddr) = res.rd;
-    } catch (const std::out_of_range& e) {
+    if (tag_bus.store_data_tag(mem_paddr, res.rd)) {
+      if (old_tag != res.rd) {
+        // the data tag can also be the CI tag of instructions beyond mem_paddr, such as all of a
+        // uniform region's
+        address_t start, end;
+        tag_bus.data_tag_span(mem_paddr, start, end);
+        insn_cache.invalidate(start, end);
+        code_tags.resync(start, end, tag_bus);
+      }
+    } else {
       printf("failed to store MR tag @ 0x%" PRIaddr " (0x%" PRIaddr ")\n", mem_addr, mem_paddr);
       fflush(stdout);
       hit_watch = true; // might as well halt
@@ -192,44 +221,72 @@ bool rv_validator_t::commit() {
   }
 
   if (has_pending_CSR && res.csrResult) {
-    for (const address_t& csr : watch_csrs) {
-      if (pending_CSR == csr && csr_tags[pending_CSR] != res.csr){
-        printf("Watch tag CSR\n");
-        fflush(stdout);
-        hit_watch = true;
+    if (has_watches) {
+      for (const address_t& csr : watch_csrs) {
+        if (pending_CSR == csr && csr_tags[pending_CSR] != res.csr){
+          printf("Watch tag CSR\n");
+          fflush(stdout);
+          hit_watch = true;
+        }
       }
     }
-    csr_tags[pending_CSR] = res.csr;
+    csr_tags.set(pending_CSR, res.csr);
   }
 
-  if (rule_cache) {
-    results_t res_copy(res);
-    if (ctx.cached && !rule_cache->allow(ops, res)) {
-      rule_cache->install_rule(ops, res_copy);
-    }
-  }
+  // validate() already looked these operands up, so install straight into the slot that missed
+  if (rule_cache && !rule_cache_hit && ctx.cached)
+    rule_cache->install_rule(rule_cache_hint, ops, res);
   return hit_watch;
 }
 
+const predecoded_insn_t& rv_validator_t::predecode(address_t pc, address_t pc_paddr, insn_bits_t insn) {
+  if (const predecoded_insn_t* cached = insn_cache.lookup(pc_paddr, insn))
+    return *cached;
+
+  decoded_instruction_t inst = decode(insn, xlen);
+  if (!inst) {
+    printf("Couldn't decode instruction at 0x%" PRIaddr " (0x%" PRIaddr "): 0x%08x   %s\n", pc, pc_paddr, insn, inst.name);
+  }
+
+  tag_t ci_tag = BAD_TAG_VALUE;
+  if (!code_tags.load(pc_paddr, ci_tag) && !tag_bus.load_insn_tag(pc_paddr, ci_tag)) {
+    printf("failed to load CI tag for PC 0x%" PRIaddr " (0x%" PRIaddr ")\n", pc, pc_paddr);
+  }
+
+  predecoded_insn_t& entry = insn_cache.slot(pc_paddr);
+  entry = predecoded_insn_t{
+    .pc=pc_paddr,
+    .bits=insn,
+    .ci_tag=ci_tag,
+    .imm=inst.imm.getOrElse(0),
+    .op=inst.op,
+    .rd=(int8_t)inst.rd.getOrElse(-1),
+    .rs1=(int8_t)inst.rs1.getOrElse(-1),
+    .rs2=(int8_t)inst.rs2.getOrElse(-1),
+    .rs3=(int8_t)inst.rs3.getOrElse(-1),
+    .has_imm=inst.imm.exists,
+    .valid=(bool)inst && ci_tag != BAD_TAG_VALUE,
+    .flags=inst.flags
+  };
+  return entry;
+}
+
 void rv_validator_t::prepare_eval(address_t pc, insn_bits_t insn) {
   failed = false;
   setup_validation();
 
   address_t pc_paddr = addr_fixer(pc);
-  decoded_instruction_t inst = decode(insn, xlen);
-  if (!inst) {
-    printf("Couldn't decode instruction at 0x%" PRIaddr " (0x%" PRIaddr "): 0x%08x   %s\n", pc, pc_paddr, insn, inst.name.c_str());
-  }
-  pending_RD = inst.rd.getOrElse(-1);
+  const predecoded_insn_t& inst = predecode(pc, pc_paddr, insn);
+  pending_RD = inst.rd;
 
-  if (inst.rs1) ops.op1 = ireg_tags[inst.rs1];
+  if (inst.rs1 >= 0) ops.op1 = ireg_tags[inst.rs1];
   if (inst.flags.has_csr_load || inst.flags.has_csr_store) ops.op2 = csr_tags[inst.imm];
-  if (inst.rs2) ops.op2 = ireg_tags[inst.rs2];
-  if (inst.rs3) ops.op3 = ireg_tags[inst.rs3];
+  if (inst.rs2 >= 0) ops.op2 = ireg_tags[inst.rs2];
+  if (inst.rs3 >= 0) ops.op3 = ireg_tags[inst.rs3];
   has_pending_CSR = inst.flags.has_csr_store;
-  has_pending_RD = inst.rd.exists;
+  has_pending_RD = inst.rd >= 0;
   has_pending_mem = inst.flags.has_store;
-  pending_CSR = inst.imm.getOrElse(-1);
+  pending_CSR = inst.has_imm ? inst.imm : -1;
 
   // Handle memory address calculation
   if (inst.flags.has_load || inst.flags.has_store) {
@@ -237,47 +294,46 @@ void rv_validator_t::prepare_eval(address_t pc, insn_bits_t insn) {
       //mem_addr has already been set
       has_insn_mem_addr = false;
     } else {
-      uint64_t reg_val = reg_reader(inst.rs1);
+      uint64_t reg_val = has_rs1_value ? rs1_value : reg_reader(inst.rs1);
 
       /* mask off upper bits, just in case */
       mem_addr = (address_t)(reg_val);
 
-      if (inst.imm)
+      if (inst.has_imm)
         mem_addr += inst.imm;
 
       /* mask off unaligned bits, just in case */
     }
     address_t mem_paddr = addr_fixer(mem_addr);
     ctx.bad_addr = mem_addr;
-    try {
-      ops.mem = tag_bus.data_tag_at(mem_paddr);
+    if (tag_bus.load_data_tag(mem_paddr, ops.mem)) {
       if (ops.mem == BAD_TAG_VALUE) {
         char buf[128];
         sprintf(buf, "TMT miss for memory (0x%" PRIaddr " (0x%" PRIaddr ")) at instruction 0x%" PRIaddr ". TMT misses are fatal.\n", mem_addr, mem_paddr, pc);
         throw std::runtime_error(buf);
       }
-    } catch (const std::out_of_range& e) {
+    } else {
       printf("failed to load MR tag -- pc: 0x%" PRIaddr " (0x%" PRIaddr ") addr: 0x%" PRIaddr " (0x%" PRIaddr ")\n", pc, pc_paddr, mem_addr, mem_paddr);
     }
   }
 
-  tag_t ci_tag = BAD_TAG_VALUE;
-  try {
-    ci_tag = tag_bus.insn_tag_at(pc_paddr);
-  } catch (const std::out_of_range& e) {
-    printf("failed to load CI tag for PC 0x%" PRIaddr " (0x%" PRIaddr ")\n", pc, pc_paddr);
-  }
   ctx.epc = pc;
-  ops.ci = ci_tag;
+  ops.ci = inst.ci_tag;
   ops.pc = pc_tag;
+  has_insn_mem_addr = false;
+  has_rs1_value = false;
+
+  // code may have been rewritten or retagged without the validator seeing it
+  if (inst.op == RISCV_FENCE_I)
+    insn_cache.flush();
 }
 
 void rv_validator_t::complete_eval() {}
 
 void rv_validator_t::config_rule_cache(const std::string& rule_cache_name, int capacity) {
   printf("%s rule cache with capacity %d!\n", rule_cache_name.c_str(), capacity);
-  std::string name_lower;
-  std::transform(rule_cache_name.begin(), rule_cache_name.end(), name_lower.begin(), [](char c){ return std::tolower(c); });
+  std::string name_lower(rule_cache_name);
+  std::transform(name_lower.begin(), name_lower.end(), name_lower.begin(), [](unsigned char c){ return std::tolower(c); });
   if (name_lower == "ideal") {
     rule_cache = new ideal_rule_cache_t();
   } else if (name_lower == "finite") {
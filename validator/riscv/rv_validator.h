@@ -27,14 +27,15 @@
 #ifndef RV32_VALIDATOR_H
 #define RV32_VALIDATOR_H
 
-#include <array>
 #include <iostream>
 #include <string>
 #include <utility>
 #include <vector>
+#include "code_tag_table.h"
 #include "dmhc_rule_cache.h"
 #include "finite_rule_cache.h"
 #include "ideal_rule_cache.h"
+#include "insn_cache.h"
 #include "metadata_memory_map.h"
 #include "policy_eval.h"
 #include "reader.h"
@@ -44,9 +45,18 @@
 
 namespace policy_engine {
 
+// An instruction to validate in a batch; matches e_v_trace_record_t
+struct trace_record_t {
+  address_t pc;
+  address_t mem_addr;
+  insn_bits_t insn;
+};
+
 class rv_validator_t : public sim_validator_t<RegisterReader_t, AddressFixer_t>, public tag_based_validator_t {
 private:
   tag_bus_t tag_bus;
+  code_tag_table_t code_tags; // CI tags of the code given to apply_metadata(), ahead of the tag bus
+  insn_cache_t insn_cache;
 
   uint32_t pending_RD;
   address_t mem_addr;
@@ -56,7 +66,11 @@ private:
   bool has_pending_CSR;
   int logIdx;
   bool has_insn_mem_addr;
+  bool has_rs1_value;
+  reg_t rs1_value; // used instead of the register reader to compute the memory address if set
   bool rule_cache_hit;
+  rule_cache_hint_t rule_cache_hint; // where the last rule cache miss should be installed
+  tag_t empty_tag; // canonized lazily so tag numbering matches the order metadata was applied
 
 public:
   const int xlen;
@@ -65,11 +79,16 @@ public:
   operands_t ops;
   results_t res;
 
+  // What validate() evaluates instructions with: the policy's eval_policy() unless something like a
+  // benchmark replaces it.
+  int (*policy_evaluator)(context_t* ctx, const operands_t* ops, results_t* res);
+
   tag_t pc_tag;
-  std::array<tag_t, 32> ireg_tags;
-  std::array<tag_t, 0x1000> csr_tags;
+  tag_array_t ireg_tags; // 32 registers
+  tag_array_t csr_tags;  // 0x1000 CSRs
   
   bool watch_pc;
+  bool has_watches; // set once anything is watched so commit can skip the checks otherwise
   std::vector<address_t> watch_regs;
   std::vector<address_t> watch_csrs;
   std::vector<address_t> watch_addrs;
@@ -82,7 +101,9 @@ public:
   // called before we call the policy code - initializes ground state of input/output structures
   void setup_validation();
 
-  void apply_metadata(const metadata_memory_map_t* md_map);
+  // Tags memory as md_map says.  The CI tags of code, such as the program's text sections, are also
+  // copied into a table that predecode() looks them up in before the tag bus.
+  void apply_metadata(const metadata_memory_map_t* md_map, const std::vector<range_t>& code = {});
 
   void handle_violation(context_t* ctx, const operands_t* ops);
 
@@ -90,18 +111,26 @@ public:
   std::pair<bool, bool> validate(address_t pc, insn_bits_t insn, address_t mem_addr);
   bool commit();
 
-  // Provides the tag for a given address.  Used for debugging.
-  tag_t& get_tag(address_t addr) { return tag_bus.data_tag_at(addr); }
+  // Validates and commits each record, returning the index of the first one that violates policy or
+  // changes a watched tag (setting hit_watch in the latter case), or n if none do.  rs1_values may be
+  // null, in which case memory addresses come from the records.
+  size_t validate_batch(const trace_record_t* records, const reg_t* rs1_values, size_t n, bool& hit_watch);
+
+  // Provides the tag for a given address.  Used for debugging.  Throws std::out_of_range if nothing
+  // is mapped there.
+  tag_t get_tag(address_t addr) { return tag_bus.data_tag(addr); }
   const meta_set_t& get_meta_set(address_t addr) { return ms_cache[get_tag(addr)]; }
   const meta_set_t& get_pc_meta_set() { return ms_cache[pc_tag]; }
   const meta_set_t& get_csr_meta_set(address_t csr) { return ms_cache[csr_tags[csr]]; }
   const meta_set_t& get_ireg_meta_set(address_t reg) { return ms_cache[ireg_tags[reg]]; }
 
-  void set_pc_watch(bool watching) { watch_pc = watching; }
-  void set_reg_watch(address_t addr) { watch_regs.push_back(addr); }
-  void set_csr_watch(address_t addr) { watch_csrs.push_back(addr); }
-  void set_mem_watch(address_t addr) { watch_addrs.push_back(addr); }
+  void set_pc_watch(bool watching) { watch_pc = watching; has_watches |= watching; }
+  void set_reg_watch(address_t addr) { watch_regs.push_back(addr); has_watches = true; }
+  void set_csr_watch(address_t addr) { watch_csrs.push_back(addr); has_watches = true; }
+  void set_mem_watch(address_t addr) { watch_addrs.push_back(addr); has_watches = true; }
 
+  // decodes insn and looks up its CI tag, or returns the cached result from a previous execution
+  const predecoded_insn_t& predecode(address_t pc, address_t pc_paddr, insn_bits_t insn);
   void prepare_eval(address_t pc, insn_bits_t insn);
   void complete_eval();
 
@@ -118,6 +147,10 @@ public:
   uint64_t rule_cache_misses;
 };
 
+// The validator whose meta set cache canonize() and get_ms() in policy_glue.cc serve policy code
+// from.  Each validator sets this once it's constructed and clears it when it's destroyed.
+extern rv_validator_t* policy_validator;
+
 } // namespace policy_engine
 
 #endif
@@ -0,0 +1,110 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#ifndef TRACE_FILE_H
+#define TRACE_FILE_H
+
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <stdexcept>
+#include <string>
+#include <vector>
+
+namespace policy_engine {
+
+/**
+ * Instruction trace for replaying through the validator without a simulator.  A trace file is a
+ * trace_header_t followed by trace_entry_t records, one per retired instruction in program order,
+ * all little-endian.  Addresses are physical.  mem_addr is the address accessed by a load or store
+ * and rs1 is the value of the instruction's rs1 register before it executed; either may be 0 for
+ * instructions that don't use them.  This header is installed for simulators to write traces with, so
+ * it only depends on the standard library.
+ */
+struct trace_header_t {
+  char magic[8];        // "PETRACE\0"
+  uint32_t version;     // trace_version
+  uint32_t entry_size;  // sizeof(trace_entry_t), for sanity checking
+};
+
+struct trace_entry_t {
+  uint64_t pc;
+  uint64_t mem_addr;
+  uint64_t rs1;
+  uint32_t insn;
+  uint32_t reserved;
+};
+
+static constexpr char trace_magic[8] = {'P', 'E', 'T', 'R', 'A', 'C', 'E', '\0'};
+static constexpr uint32_t trace_version = 1;
+
+class trace_reader_t {
+private:
+  FILE* file;
+
+public:
+  trace_reader_t(const std::string& path) : file(std::fopen(path.c_str(), "rb")) {
+    if (!file)
+      throw std::runtime_error("could not open trace " + path);
+    trace_header_t header;
+    if (std::fread(&header, sizeof(header), 1, file) != 1 || std::memcmp(header.magic, trace_magic, sizeof(trace_magic)) != 0) {
+      std::fclose(file);
+      throw std::runtime_error(path + " is not a trace file");
+    }
+    if (header.version != trace_version || header.entry_size != sizeof(trace_entry_t)) {
+      std::fclose(file);
+      throw std::runtime_error(path + " has unsupported trace version " + std::to_string(header.version));
+    }
+  }
+
+  ~trace_reader_t() { std::fclose(file); }
+
+  // Reads up to entries.size() records into entries and returns how many were read.
+  size_t read(std::vector<trace_entry_t>& entries) {
+    return std::fread(entries.data(), sizeof(trace_entry_t), entries.size(), file);
+  }
+};
+
+class trace_writer_t {
+private:
+  FILE* file;
+
+public:
+  trace_writer_t(const std::string& path) : file(std::fopen(path.c_str(), "wb")) {
+    if (!file)
+      throw std::runtime_error("could not open trace " + path);
+    trace_header_t header{{}, trace_version, sizeof(trace_entry_t)};
+    std::memcpy(header.magic, trace_magic, sizeof(trace_magic));
+    std::fwrite(&header, sizeof(header), 1, file);
+  }
+
+  ~trace_writer_t() { std::fclose(file); }
+
+  void write(const trace_entry_t& entry) { std::fwrite(&entry, sizeof(entry), 1, file); }
+};
+
+} // namespace policy_engine
+
+#endif
@@ -0,0 +1,187 @@
+/*
+ * Copyright © 2017-2018 Dover Microsystems, Inc.
+ * All rights reserved. 
+ *
+ * Use and disclosure subject to the following license. 
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining
+ * a copy of this software and associated documentation files (the
+ * "Software"), to deal in the Software without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Software, and to
+ * permit persons to whom the Software is furnished to do so, subject to
+ * the following conditions:
+ * 
+ * The above copyright notice and this permission notice shall be
+ * included in all copies or substantial portions of the Software.
+ * 
+ * THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND
+ * NONINFRINGEMENT. IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE
+ * LIABLE FOR ANY CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION
+ * OF CONTRACT, TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION
+ * WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE SOFTWARE.
+ */
+#include <chrono>
+#include <cinttypes>
+#include <cstdint>
+#include <cstdio>
+#include <gflags/gflags.h>
+#include <memory>
+#include <string>
+#include <strings.h>
+#include <vector>
+#include <yaml-cpp/yaml.h>
+#include "elf_loader.h"
+#include "metadata_memory_map.h"
+#include "rv_validator.h"
+#include "tag_file.h"
+#include "trace_file.h"
+#include "validator_exception.h"
+
+DEFINE_string(validator_cfg, "", "Validator yaml configuration, as passed to e_v_set_metadata");
+DEFINE_string(policy_dir, "", "Directory with generated policy yaml (overrides validator_cfg)");
+DEFINE_string(tags_file, "", "Taginfo file (overrides validator_cfg)");
+DEFINE_string(soc_cfg_path, "", "SOC configuration file (overrides validator_cfg)");
+DEFINE_string(elf_file, "", "Program whose code's CI tags are kept in a code-tag table (overrides validator_cfg)");
+DEFINE_string(rule_cache, "", "Rule cache to use: ideal, finite, dmhc, or none (overrides validator_cfg)");
+DEFINE_int32(rule_cache_capacity, 0, "Rule cache capacity, required for finite and dmhc (overrides validator_cfg)");
+DEFINE_string(trace, "", "Instruction trace to replay");
+DEFINE_bool(batch, false, "Replay through validate_batch instead of one instruction at a time");
+DEFINE_bool(mem_addr, false, "Use recorded memory addresses instead of computing them from rs1");
+DEFINE_bool(keep_going, false, "Count violations and keep replaying instead of stopping at the first");
+
+static std::unique_ptr<policy_engine::rv_validator_t> rv_validator;
+
+// register and address stand-ins for the simulator; the trace supplies rs1 for the current instruction
+static uint64_t current_rs1;
+static uint64_t trace_reg_reader(uint32_t) { return current_rs1; }
+static uint64_t trace_addr_fixer(uint64_t addr) { return addr; }
+
+static void load_validator_cfg(const std::string& path) {
+  YAML::Node cfg = YAML::LoadFile(path);
+  if (FLAGS_policy_dir.empty() && cfg["policy_dir"])
+    FLAGS_policy_dir = cfg["policy_dir"].as<std::string>();
+  if (FLAGS_tags_file.empty() && cfg["tags_file"])
+    FLAGS_tags_file = cfg["tags_file"].as<std::string>();
+  if (FLAGS_soc_cfg_path.empty() && cfg["soc_cfg_path"])
+    FLAGS_soc_cfg_path = cfg["soc_cfg_path"].as<std::string>();
+  if (FLAGS_elf_file.empty() && cfg["elf_file"])
+    FLAGS_elf_file = cfg["elf_file"].as<std::string>();
+  if (cfg["rule_cache"]) {
+    if (FLAGS_rule_cache.empty() && cfg["rule_cache"]["name"])
+      FLAGS_rule_cache = cfg["rule_cache"]["name"].as<std::string>();
+    if (FLAGS_rule_cache_capacity == 0 && cfg["rule_cache"]["capacity"])
+      FLAGS_rule_cache_capacity = cfg["rule_cache"]["capacity"].as<int>();
+  }
+}
+
+// Same steps as e_v_set_callbacks
+static void load_validator() {
+  uint32_t xlen = 32;
+  policy_engine::metadata_memory_map_t map;
+  if (!policy_engine::load_metadata(map, FLAGS_tags_file, xlen))
+    throw policy_engine::configuration_exception_t("failed to read taginfo " + FLAGS_tags_file);
+  rv_validator = std::make_unique<policy_engine::rv_validator_t>(xlen, FLAGS_policy_dir, FLAGS_soc_cfg_path, trace_reg_reader, trace_addr_fixer);
+  std::vector<policy_engine::range_t> code;
+  if (!FLAGS_elf_file.empty())
+    code = policy_engine::elf_image_t(FLAGS_elf_file).code_ranges();
+  rv_validator->apply_metadata(&map, code);
+  if (!FLAGS_rule_cache.empty() && FLAGS_rule_cache != "none") {
+    // only the ideal cache is unbounded; the others would have no room for a single rule
+    if (FLAGS_rule_cache_capacity <= 0 && strcasecmp(FLAGS_rule_cache.c_str(), "ideal") != 0)
+      throw policy_engine::configuration_exception_t(FLAGS_rule_cache + " rule cache needs a capacity above 0; set --rule_cache_capacity or rule_cache.capacity");
+    rv_validator->config_rule_cache(FLAGS_rule_cache, FLAGS_rule_cache_capacity);
+  }
+}
+
+static void report_violation(uint64_t index) {
+  std::printf("violation at instruction %" PRIu64 ": pc 0x%" PRIaddr, index, rv_validator->failed_ctx.epc);
+  if (rv_validator->failed_ctx.bad_addr)
+    std::printf(" mem 0x%" PRIaddr, rv_validator->failed_ctx.bad_addr);
+  if (rv_validator->failed_ctx.fail_msg)
+    std::printf(": %s", rv_validator->failed_ctx.fail_msg);
+  std::printf("\n");
+}
+
+int main(int argc, char* argv[]) {
+  gflags::SetUsageMessage("Replay an instruction trace through the RISC-V validator");
+  gflags::ParseCommandLineFlags(&argc, &argv, true);
+
+  if (FLAGS_trace.empty()) {
+    gflags::ShowUsageWithFlags(argv[0]);
+    return 1;
+  }
+
+  try {
+    if (!FLAGS_validator_cfg.empty())
+      load_validator_cfg(FLAGS_validator_cfg);
+    load_validator();
+
+    policy_engine::trace_reader_t trace(FLAGS_trace);
+    std::vector<policy_engine::trace_entry_t> entries(1 << 16);
+    std::vector<policy_engine::trace_record_t> records;
+    std::vector<reg_t> rs1_values;
+    uint64_t instructions = 0;
+    uint64_t violations = 0;
+    bool stopped = false;
+
+    auto start = std::chrono::steady_clock::now();
+    while (!stopped) {
+      size_t n = trace.read(entries);
+      if (n == 0)
+        break;
+
+      if (FLAGS_batch) {
+        records.resize(n);
+        rs1_values.resize(n);
+        for (size_t i = 0; i < n; i++) {
+          records[i] = policy_engine::trace_record_t{entries[i].pc, entries[i].mem_addr, entries[i].insn};
+          rs1_values[i] = entries[i].rs1;
+        }
+        for (size_t i = 0; i < n && !stopped;) {
+          bool hit_watch;
+          size_t stop = i + rv_validator->validate_batch(&records[i], FLAGS_mem_addr ? nullptr : &rs1_values[i], n - i, hit_watch);
+          if (stop < n && !hit_watch) {
+            violations++;
+            report_violation(instructions + stop - i);
+            stopped = !FLAGS_keep_going;
+          }
+          // the instruction the batch stopped at has been handled either way
+          size_t next = stop < n ? stop + 1 : n;
+          instructions += next - i;
+          i = next;
+        }
+      } else {
+        for (size_t i = 0; i < n && !stopped; i++) {
+          const policy_engine::trace_entry_t& e = entries[i];
+          current_rs1 = e.rs1;
+          bool allowed = FLAGS_mem_addr ? rv_validator->validate(e.pc, e.insn, e.mem_addr).first : rv_validator->validate(e.pc, e.insn);
+          if (allowed) {
+            rv_validator->commit();
+          } else {
+            violations++;
+            report_violation(instructions);
+            stopped = !FLAGS_keep_going;
+          }
+          instructions++;
+        }
+      }
+    }
+    double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+    uint64_t lookups = rv_validator->rule_cache_hits + rv_validator->rule_cache_misses;
+    std::printf("instructions: %" PRIu64 "\n", instructions);
+    std::printf("violations: %" PRIu64 "\n", violations);
+    std::printf("wall time: %.3f s\n", seconds);
+    std::printf("instructions/sec: %.0f\n", instructions/seconds);
+    if (rv_validator->rule_cache)
+      std::printf("rule cache: %" PRIu64 " hits, %" PRIu64 " misses, %.2f%% hit rate\n",
+        rv_validator->rule_cache_hits, rv_validator->rule_cache_misses, lookups ? 100.0*rv_validator->rule_cache_hits/lookups : 0.0);
+    return violations == 0 ? 0 : 2;
+  } catch (const std::exception& e) {
+    std::printf("%s\n", e.what());
+    return 1;
+  }
+}
@@ -1,15 +1,42 @@
 #ifndef __BASE_RULE_CACHE_H__
 #define __BASE_RULE_CACHE_H__
 
+#include <cstddef>
+#include <cstdint>
 #include "riscv_isa.h"
 
 namespace policy_engine {
 
+class rule_cache_t;
+
+// Where a failed probe() left off, so that installing the rule for the missed operands doesn't have to
+// look them up again.  A hint is only good until its cache is next modified.
+struct rule_cache_hint_t {
+  const rule_cache_t* cache = nullptr; // cache that produced the hint, null if there is none
+  uint64_t generation = 0;             // state of the cache when the hint was produced
+  uint64_t hash = 0;
+  size_t slot = 0;
+};
+
 class rule_cache_t {
 public:
+  virtual ~rule_cache_t() {}
+
   virtual void flush() = 0;
   virtual void install_rule(const operands_t& ops, const results_t& res) = 0;
   virtual bool allow(const operands_t& ops, results_t& res) = 0;
+
+  // Same as allow(), but fills in hint on a miss.
+  virtual bool probe(const operands_t& ops, results_t& res, rule_cache_hint_t& hint) {
+    hint = rule_cache_hint_t{};
+    return allow(ops, res);
+  }
+
+  // Installs a rule for the operands that missed in the probe() that produced hint, falling back to
+  // install_rule() if the hint is stale.
+  virtual void install_rule(const rule_cache_hint_t&, const operands_t& ops, const results_t& res) {
+    install_rule(ops, res);
+  }
 };
 
 } // namespace policy_engine
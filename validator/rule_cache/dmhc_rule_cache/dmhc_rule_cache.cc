@@ -5,7 +5,7 @@
 
 namespace policy_engine {
 
-dmhc_rule_cache_t::dmhc_rule_cache_t(int capacity, int iwidth, int owidth, int k, bool no_evict) {
+dmhc_rule_cache_t::dmhc_rule_cache_t(int capacity, int iwidth, int owidth, int k, bool no_evict) : generation(0) {
   int ops_size[OPS_LEN];
   ops_size[OP_PC] = iwidth;
   ops_size[OP_CI] = iwidth;
@@ -29,7 +29,26 @@ dmhc_rule_cache_t::dmhc_rule_cache_t(int capacity, int iwidth, int owidth, int k
   consider[OP_MEM] = false;
 }
 
+void dmhc_rule_cache_t::set_operands(const operands_t& ops) {
+  generation++;
+  ops_copy = ops;
+  consider[OP_OP1] = ops.op1 != BAD_TAG_VALUE;
+  consider[OP_OP2] = ops.op2 != BAD_TAG_VALUE;
+  consider[OP_OP3] = ops.op3 != BAD_TAG_VALUE;
+  consider[OP_MEM] = ops.mem != BAD_TAG_VALUE;
+}
+
 void dmhc_rule_cache_t::install_rule(const operands_t& ops, const results_t& res) {
+  set_operands(ops);
+  install_rule(rule_cache_hint_t{this, generation}, ops, res);
+}
+
+// The hint only records that ops_copy and consider still hold the operands of the missed lookup.
+void dmhc_rule_cache_t::install_rule(const rule_cache_hint_t& hint, const operands_t& ops, const results_t& res) {
+  if (hint.cache != this || hint.generation != generation) {
+    install_rule(ops, res);
+    return;
+  }
   res_copy = res;
 #ifdef DMHC_DEBUG
   printf("Install\n");
@@ -44,14 +63,11 @@ void dmhc_rule_cache_t::install_rule(const operands_t& ops, const results_t& res
          res_copy.pcResult, res_copy.rdResult,  res_copy.csrResult);
 #endif
   the_rule_cache->insert(ops_copy, res_copy, consider);
+  generation++;
 }
 
 bool dmhc_rule_cache_t::allow(const operands_t& ops, results_t& res) {
-  ops_copy = ops;
-  consider[OP_OP1] = ops.op1 != BAD_TAG_VALUE;
-  consider[OP_OP2] = ops.op2 != BAD_TAG_VALUE;
-  consider[OP_OP3] = ops.op3 != BAD_TAG_VALUE;
-  consider[OP_MEM] = ops.mem != BAD_TAG_VALUE;
+  set_operands(ops);
 
 #ifdef DMHC_DEBUG
   printf("Allow\nops - pc: %" PRItag ", ci: %" PRItag, ops_copy.pc, ops_copy.ci);
@@ -77,8 +93,16 @@ bool dmhc_rule_cache_t::allow(const operands_t& ops, results_t& res) {
   }
 }
 
+bool dmhc_rule_cache_t::probe(const operands_t& ops, results_t& res, rule_cache_hint_t& hint) {
+  if (allow(ops, res))
+    return true;
+  hint = rule_cache_hint_t{this, generation};
+  return false;
+}
+
 void dmhc_rule_cache_t::flush() {
   the_rule_cache->reset();
+  generation++;
 }
 
 } // namespace policy_engine
@@ -37,14 +37,19 @@ public:
   dmhc_rule_cache_t(int capacity, int iwidth, int owidth, int k, bool no_evict);
   ~dmhc_rule_cache_t() {}
 
-  void install_rule(const operands_t& ops, const results_t& res); //Not used
+  void install_rule(const operands_t& ops, const results_t& res);
+  void install_rule(const rule_cache_hint_t& hint, const operands_t& ops, const results_t& res);
   bool allow(const operands_t& ops, results_t& res);
+  bool probe(const operands_t& ops, results_t& res, rule_cache_hint_t& hint);
   void flush();
 
 private:
-  operands_t ops_copy;
+  operands_t ops_copy;  // operands and don't-care fields from the last lookup
   results_t res_copy;
   bool consider[OPS_LEN];
+  uint64_t generation;  // counts lookups and changes so hints can tell if ops_copy is still theirs
+
+  void set_operands(const operands_t& ops);
   dmhc_t* the_rule_cache;
 };
 
@@ -7,16 +7,14 @@
 
 namespace policy_engine {
 
-void finite_rule_cache_t::install_rule(const operands_t& ops, const results_t& res) {
+void finite_rule_cache_t::evict() {
   if (cache_full) {
-    auto existing_entry = rule_cache_table.find(entries[next_entry]);
-    if (existing_entry == rule_cache_table.end()) {
+    if (!rule_cache_table.erase(entries[next_entry]))
       printf("Internal error in rule cache - do not trust results.\n");
-    } else {
-      rule_cache_table.erase(existing_entry);
-    }
   }
-  rule_cache_table[ops] = res;
+}
+
+void finite_rule_cache_t::record(const operands_t& ops) {
   entries[next_entry] = ops;
 
   next_entry++;
@@ -26,17 +24,26 @@ void finite_rule_cache_t::install_rule(const operands_t& ops, const results_t& r
   }
 }
 
-bool finite_rule_cache_t::allow(const operands_t& ops, results_t& res) {
-  auto existing_entry = rule_cache_table.find(ops);
-  if (existing_entry != rule_cache_table.end()) {
-    res.pc = existing_entry->second.pc;
-    res.rd = existing_entry->second.rd;
-    res.csr = existing_entry->second.csr;
-    res.pcResult = existing_entry->second.pcResult;
-    res.rdResult = existing_entry->second.rdResult;
-    res.csrResult = existing_entry->second.csrResult;
-  }
-  return existing_entry != rule_cache_table.end();
+void finite_rule_cache_t::install_rule(const operands_t& ops, const results_t& res) {
+  evict();
+  rule_cache_table.insert(ops, res);
+  record(ops);
+}
+
+void finite_rule_cache_t::install_rule(const rule_cache_hint_t& hint, const operands_t& ops, const results_t& res) {
+  // Eviction only turns a live slot into a tombstone, which can't move the missed operands' free slot
+  // off their probe sequence, so check the hint before evicting and use it afterward.
+  bool fresh = hint.cache == this && hint.generation == rule_cache_table.generation();
+  evict();
+  if (!fresh || !rule_cache_table.insert_at(hint.slot, ops, res, hint.hash))
+    rule_cache_table.insert(ops, res);
+  record(ops);
+}
+
+void finite_rule_cache_t::flush() {
+  ideal_rule_cache_t::flush();
+  cache_full = false;
+  next_entry = 0;
 }
 
 } // namespace policy_engine
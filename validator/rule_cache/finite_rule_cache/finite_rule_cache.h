@@ -1,8 +1,6 @@
 #ifndef __FINITE_RULE_CACHE_H__
 #define __FINITE_RULE_CACHE_H__
 
-#include <functional>
-#include <unordered_map>
 #include <vector>
 #include "ideal_rule_cache.h"
 #include "riscv_isa.h"
@@ -15,7 +13,8 @@ public:
   ~finite_rule_cache_t() {}
 
   void install_rule(const operands_t& ops, const results_t& res);
-  bool allow(const operands_t& ops, results_t& res);
+  void install_rule(const rule_cache_hint_t& hint, const operands_t& ops, const results_t& res);
+  void flush();
 
 private:
   // the number of rules the cache can hold.
@@ -35,6 +34,9 @@ private:
   // the next location into which we will insert an entry in the "entries"
   // array.
   int next_entry;
+
+  void evict();
+  void record(const operands_t& ops);
 };
 
 } // namespace policy_engine
@@ -16,20 +16,31 @@ ideal_rule_cache_t::~ideal_rule_cache_t() {
 }
 
 void ideal_rule_cache_t::install_rule(const operands_t& ops, const results_t& res) {
-  rule_cache_table[ops] = res;
+  rule_cache_table.insert(ops, res);
+}
+
+void ideal_rule_cache_t::install_rule(const rule_cache_hint_t& hint, const operands_t& ops, const results_t& res) {
+  if (hint.cache != this || hint.generation != rule_cache_table.generation() || !rule_cache_table.insert_at(hint.slot, ops, res, hint.hash))
+    rule_cache_table.insert(ops, res);
 }
 
 bool ideal_rule_cache_t::allow(const operands_t& ops, results_t& res) {
-  auto entries = rule_cache_table.find(ops);
-  if (entries != rule_cache_table.end()) {
-    res.pc = entries->second.pc;
-    res.rd = entries->second.rd;
-    res.csr = entries->second.csr;
-    res.pcResult = entries->second.pcResult;
-    res.rdResult = entries->second.rdResult;
-    res.csrResult = entries->second.csrResult;
+  size_t entry = rule_cache_table.find(ops);
+  if (entry != rule_table_t::npos)
+    res = rule_cache_table.results(entry);
+  return entry != rule_table_t::npos;
+}
+
+bool ideal_rule_cache_t::probe(const operands_t& ops, results_t& res, rule_cache_hint_t& hint) {
+  uint64_t hash = rule_table_t::hash(ops);
+  size_t slot;
+  size_t entry = rule_cache_table.find(ops, hash, slot);
+  if (entry != rule_table_t::npos) {
+    res = rule_cache_table.results(entry);
+    return true;
   }
-  return entries != rule_cache_table.end();
+  hint = rule_cache_hint_t{this, rule_cache_table.generation(), hash, slot};
+  return false;
 }
 
 }
\ No newline at end of file
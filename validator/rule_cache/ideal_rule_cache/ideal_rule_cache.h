@@ -1,10 +1,9 @@
 #ifndef __IDEAL_RULE_CACHE_H__
 #define __IDEAL_RULE_CACHE_H__
 
-#include <functional>
-#include <unordered_map>
 #include "base_rule_cache.h"
 #include "riscv_isa.h"
+#include "rule_table.h"
 
 namespace policy_engine {
 
@@ -17,11 +16,13 @@ public:
   ~ideal_rule_cache_t();
 
   void install_rule(const operands_t& ops, const results_t& res);
+  void install_rule(const rule_cache_hint_t& hint, const operands_t& ops, const results_t& res);
   bool allow(const operands_t& ops, results_t& res);
+  bool probe(const operands_t& ops, results_t& res, rule_cache_hint_t& hint);
   void flush();
 
 protected:
-  std::unordered_map<operands_t, results_t> rule_cache_table;
+  rule_table_t rule_cache_table;
 };
 
 } // namespace policy_engine
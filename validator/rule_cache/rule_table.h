@@ -0,0 +1,185 @@
+#ifndef __RULE_TABLE_H__
+#define __RULE_TABLE_H__
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <functional>
+#include <vector>
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+#include "riscv_isa.h"
+
+namespace policy_engine {
+
+/**
+ * Open-addressing hash table from operands to results.  Keys and values are stored inline in a flat
+ * slot array, and a parallel array of control bytes holds 7 bits of each key's hash so that a probe
+ * can rule out a group of 16 slots with a single vector compare before touching any keys.
+ */
+class rule_table_t {
+private:
+  static constexpr size_t group_size = 16;
+  static constexpr int8_t empty = -128;
+  static constexpr int8_t deleted = -2;
+
+  struct slot_t {
+    operands_t ops;
+    results_t res;
+  };
+
+  std::vector<int8_t> ctrl;
+  std::vector<slot_t> slots;
+  size_t group_mask;
+  size_t used;       // live entries
+  size_t tombstones; // deleted entries still occupying control bytes
+  uint64_t changes;  // bumped whenever a slot changes state, which invalidates insertion slots
+
+  static int8_t h2(uint64_t hash) { return hash & 0x7f; }
+
+  // bit i is set if control byte i of the group equals b
+  static uint32_t match(const int8_t* group, int8_t b) {
+#if defined(__SSE2__)
+    __m128i ctrl = _mm_loadu_si128(reinterpret_cast<const __m128i*>(group));
+    return _mm_movemask_epi8(_mm_cmpeq_epi8(ctrl, _mm_set1_epi8(b)));
+#else
+    uint32_t bits = 0;
+    for (size_t i = 0; i < group_size; i++)
+      bits |= (uint32_t)(group[i] == b) << i;
+    return bits;
+#endif
+  }
+
+  // bit i is set if slot i of the group is empty or deleted
+  static uint32_t match_free(const int8_t* group) {
+#if defined(__SSE2__)
+    return _mm_movemask_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(group)));
+#else
+    uint32_t bits = 0;
+    for (size_t i = 0; i < group_size; i++)
+      bits |= (uint32_t)(group[i] < 0) << i;
+    return bits;
+#endif
+  }
+
+  void rehash(size_t groups) {
+    std::vector<int8_t> old_ctrl(groups*group_size, empty);
+    std::vector<slot_t> old_slots(groups*group_size);
+    old_ctrl.swap(ctrl);
+    old_slots.swap(slots);
+    group_mask = groups - 1;
+    used = 0;
+    tombstones = 0;
+    changes++;
+    for (size_t i = 0; i < old_ctrl.size(); i++) {
+      if (old_ctrl[i] >= 0) {
+        uint64_t h = hash(old_slots[i].ops);
+        size_t slot = find_free(h);
+        ctrl[slot] = h2(h);
+        slots[slot] = old_slots[i];
+        used++;
+      }
+    }
+  }
+
+  size_t find_free(uint64_t hash) const {
+    for (size_t g = (hash >> 7) & group_mask, step = 1;; g = (g + step++) & group_mask) {
+      if (uint32_t free = match_free(&ctrl[g*group_size]))
+        return g*group_size + __builtin_ctz(free);
+    }
+  }
+
+public:
+  static constexpr size_t npos = SIZE_MAX;
+
+  rule_table_t() : ctrl(group_size, empty), slots(group_size), group_mask(0), used(0), tombstones(0), changes(0) {}
+
+  static uint64_t hash(const operands_t& ops) { return std::hash<operands_t>()(ops); }
+
+  size_t size() const { return used; }
+  size_t capacity() const { return slots.size(); }
+  uint64_t generation() const { return changes; }
+
+  /**
+   * Looks up ops.  Returns the index of its slot if it's present.  Otherwise returns npos and sets
+   * insert_slot to where insert_at() can put it, which stays valid until the table is next modified.
+   */
+  size_t find(const operands_t& ops, uint64_t hash, size_t& insert_slot) const {
+    insert_slot = npos;
+    for (size_t g = (hash >> 7) & group_mask, step = 1;; g = (g + step++) & group_mask) {
+      const int8_t* group = &ctrl[g*group_size];
+      for (uint32_t m = match(group, h2(hash)); m != 0; m &= m - 1) {
+        size_t i = g*group_size + __builtin_ctz(m);
+        if (std::memcmp(&slots[i].ops, &ops, sizeof(operands_t)) == 0)
+          return i;
+      }
+      uint32_t free = match_free(group);
+      if (free != 0 && insert_slot == npos)
+        insert_slot = g*group_size + __builtin_ctz(free);
+      if (match(group, empty) != 0)
+        return npos;
+    }
+  }
+
+  size_t find(const operands_t& ops) const {
+    size_t insert_slot;
+    return find(ops, hash(ops), insert_slot);
+  }
+
+  const results_t& results(size_t slot) const { return slots[slot].res; }
+  results_t& results(size_t slot) { return slots[slot].res; }
+
+  // Fills a slot returned by a failed find().  Returns false if the table had to grow first, which
+  // means the slot was not used; call insert() in that case.
+  bool insert_at(size_t slot, const operands_t& ops, const results_t& res, uint64_t hash) {
+    if ((used + tombstones + 1)*8 > capacity()*7)
+      return false;
+    if (ctrl[slot] == deleted)
+      tombstones--;
+    ctrl[slot] = h2(hash);
+    slots[slot] = slot_t{ops, res};
+    used++;
+    changes++;
+    return true;
+  }
+
+  // Adds ops -> res, replacing any existing results for ops.
+  void insert(const operands_t& ops, const results_t& res) {
+    uint64_t h = hash(ops);
+    size_t insert_slot;
+    size_t slot = find(ops, h, insert_slot);
+    if (slot != npos) {
+      slots[slot].res = res;
+      return;
+    }
+    if (!insert_at(insert_slot, ops, res, h)) {
+      // grow if mostly live, otherwise just clear out tombstones
+      rehash(used*2 >= capacity() ? (group_mask + 1)*2 : group_mask + 1);
+      insert_at(find_free(h), ops, res, h);
+    }
+  }
+
+  bool erase(const operands_t& ops) {
+    size_t slot = find(ops);
+    if (slot == npos)
+      return false;
+    ctrl[slot] = deleted;
+    used--;
+    tombstones++;
+    changes++;
+    return true;
+  }
+
+  void clear() {
+    std::fill(ctrl.begin(), ctrl.end(), empty);
+    used = 0;
+    tombstones = 0;
+    changes++;
+  }
+};
+
+} // namespace policy_engine
+
+#endif// __RULE_TABLE_H__
@@ -25,14 +25,19 @@
  */
 
 #include <algorithm>
+#include <atomic>
+#include <cinttypes>
+#include <condition_variable>
 #include <cstring>
 #include <cstdint>
 #include <cstdio>
 #include <exception>
 #include <linux/limits.h>
 #include <memory>
+#include <mutex>
 #include <sstream>
 #include <string>
+#include <thread>
 #include <unordered_map>
 #include <vector>
 #include <yaml-cpp/yaml.h>
@@ -129,7 +134,7 @@ std::map<std::string, const metadata_t*> metadata_factory_t::lookup_metadata_map
   return results;
 }
 
-const metadata_t* metadata_factory_t::lookup_group_metadata(const std::string& opgroup, const decoded_instruction_t& inst) {
+const metadata_t* metadata_factory_t::lookup_group_metadata(std::string_view opgroup, const decoded_instruction_t& inst) {
   const auto& it_opgroup_rule = opgroup_rule_map.find(opgroup);
   if (it_opgroup_rule != opgroup_rule_map.end()) {
     if (it_opgroup_rule->second.matches(inst))
@@ -151,7 +156,7 @@ static const std::unordered_map<std::string, operand_rule_match_t> operand_match
   {"match_not_in_range", OPERAND_RULE_NOT_RANGE},
 };
 
-void metadata_factory_t::update_rule_map(std::string key, const YAML::Node& node) {
+void metadata_factory_t::update_rule_map(std::string_view key, const YAML::Node& node) {
   std::string name;
   YAML::Node operand_rules;
   std::unique_ptr<metadata_t> metadata = std::make_unique<metadata_t>();
@@ -188,7 +193,7 @@ void metadata_factory_t::update_rule_map(std::string key, const YAML::Node& node
 
 void metadata_factory_t::init_group_map(const YAML::Node& node) {
   for (const auto& it : node["Groups"]) {
-    const std::string key = it.first.as<std::string>();
+    std::string_view key = *opgroup_names.insert(it.first.as<std::string>()).first;
     std::unique_ptr<metadata_t> md = std::make_unique<metadata_t>();
     const YAML::Node& instruction_node = it.second;
 
@@ -236,21 +241,150 @@ bool metadata_factory_t::apply_tag(metadata_memory_map_t& map, uint64_t start, u
   return false;
 }
 
-void metadata_factory_t::tag_opcodes(metadata_memory_map_t& map, uint64_t base_address, int xlen, const void* bytes, int n, reporter_t& err) {
-  for (int pc = 0, npc = 0; pc < n; pc = npc) {
+// Decodes the instructions starting at pc until one starts at or past stop, appending what tag_opcodes()
+// does with each one to runs; consecutive instructions with the same metadata share a run.  Returns the
+// offset of the instruction after the last one.
+int metadata_factory_t::decode_opcodes(std::vector<opcode_run_t>& runs, uint64_t base_address, int xlen, const void* bytes, int pc, int stop) {
+  char warning[256];
+  for (int npc = pc; pc < stop; pc = npc) {
     insn_bits_t bits = *reinterpret_cast<const insn_bits_t*>((uintptr_t) bytes + pc);
     decoded_instruction_t inst = decode(bits, xlen);
+    const metadata_t* metadata = nullptr;
     if (!inst) {
-      err.warning("Failed to decode instruction 0x%08x at address %#x\n", bits, base_address + pc);
+      std::snprintf(warning, sizeof(warning), "Failed to decode instruction 0x%08x at address %#" PRIx64 "\n", bits, base_address + pc);
       npc = pc + 4;
     } else {
       npc = pc + (inst.flags.is_compressed ? 2 : 4);
-      if (const metadata_t* metadata = lookup_group_metadata(inst.name, inst))
-        map.add_range(base_address + pc, base_address + npc, *metadata);
+      if (!(metadata = lookup_group_metadata(inst.name, inst)))
+        std::snprintf(warning, sizeof(warning), "0x%016lx: 0x%08x  %s - no group found for instruction\n", base_address + pc, inst.flags.is_compressed ? bits & 0xffff : bits, inst.name);
+    }
+    if (metadata && !runs.empty() && runs.back().metadata == metadata && runs.back().end == pc)
+      runs.back().end = npc;
+    else
+      runs.push_back(opcode_run_t{pc, npc, metadata, metadata ? "" : warning});
+  }
+  return pc;
+}
+
+/**
+ * Tags each instruction in bytes with the metadata for its group.  With more than one thread, the code
+ * is split into chunks that are decoded in parallel and then applied to the map in order, so the map
+ * and the warnings come out the same as decoding it all in one go.  Instructions are two or four
+ * bytes, so the one before a chunk can end at its start or two bytes into it; each chunk is decoded
+ * from both until the two decodings reach the same instruction, which doesn't usually take long.
+ */
+void metadata_factory_t::tag_opcodes(metadata_memory_map_t& map, uint64_t base_address, int xlen, const void* bytes, int n, reporter_t& err, unsigned threads) {
+  static constexpr int min_chunk_size = 1 << 14;
+
+  auto apply = [&](std::vector<opcode_run_t>::const_iterator begin, std::vector<opcode_run_t>::const_iterator end) {
+    for (auto it = begin; it != end; ++it) {
+      if (it->metadata)
+        map.add_range(base_address + it->start, base_address + it->end, *it->metadata);
       else
-        err.warning("0x%016lx: 0x%08x  %s - no group found for instruction\n", base_address + pc, inst.flags.is_compressed ? bits & 0xffff : bits, inst.name);
+        err.warning("%s", it->warning);
+    }
+  };
+
+  int chunk_size = threads > 1 ? std::max(n/(int)(4*threads), min_chunk_size) : n;
+  chunk_size += -chunk_size & 3;
+  if (chunk_size >= n) {
+    std::vector<opcode_run_t> runs;
+    decode_opcodes(runs, base_address, xlen, bytes, 0, n);
+    apply(runs.begin(), runs.end());
+    return;
+  }
+
+  struct chunk_t {
+    int start;
+    int stop;
+    std::vector<opcode_run_t> runs; // decoded from start
+    int end;
+    std::vector<opcode_run_t> skewed_runs; // decoded from start + 2 up to meet, or to stop if they don't meet
+    int skewed_end;
+    int meet;
+    bool done = false;
+    std::exception_ptr error;
+  };
+  std::vector<chunk_t> chunks((n + chunk_size - 1)/chunk_size);
+  for (size_t i = 0; i < chunks.size(); i++) {
+    chunks[i].start = i*chunk_size;
+    chunks[i].stop = std::min(chunks[i].start + chunk_size, n);
+  }
+
+  auto length = [&](int pc) {
+    decoded_instruction_t inst = decode(*reinterpret_cast<const insn_bits_t*>((uintptr_t) bytes + pc), xlen);
+    return inst && inst.flags.is_compressed ? 2 : 4;
+  };
+  std::mutex mutex;
+  std::condition_variable decoded;
+  std::atomic<size_t> next(0);
+  auto decode_chunks = [&]() {
+    for (size_t i; (i = next++) < chunks.size();) {
+      chunk_t& chunk = chunks[i];
+      try {
+        int pc = chunk.start, skewed_pc = chunk.start + 2;
+        while (pc != skewed_pc && std::min(pc, skewed_pc) < chunk.stop) {
+          if (pc < skewed_pc)
+            pc += length(pc);
+          else
+            skewed_pc += length(skewed_pc);
+        }
+        chunk.meet = pc == skewed_pc ? pc : -1;
+        chunk.skewed_end = decode_opcodes(chunk.skewed_runs, base_address, xlen, bytes, chunk.start + 2, chunk.meet >= 0 ? chunk.meet : chunk.stop);
+        chunk.end = decode_opcodes(chunk.runs, base_address, xlen, bytes, chunk.start, chunk.stop);
+      } catch (...) {
+        chunk.error = std::current_exception();
+      }
+      std::lock_guard<std::mutex> lock(mutex);
+      chunk.done = true;
+      decoded.notify_all();
+    }
+  };
+  std::vector<std::thread> pool;
+  for (unsigned i = 0; i < threads; i++)
+    pool.emplace_back(decode_chunks);
+
+  // apply each chunk as soon as it's decoded, starting from wherever the last instruction of the one
+  // before it ended
+  std::exception_ptr error;
+  try {
+    int pc = 0;
+    for (chunk_t& chunk : chunks) {
+      {
+        std::unique_lock<std::mutex> lock(mutex);
+        decoded.wait(lock, [&]() { return chunk.done; });
+      }
+      if (chunk.error) {
+        std::rethrow_exception(chunk.error);
+      } else if (pc == chunk.start) {
+        apply(chunk.runs.begin(), chunk.runs.end());
+        pc = chunk.end;
+      } else if (pc == chunk.start + 2) {
+        apply(chunk.skewed_runs.begin(), chunk.skewed_runs.end());
+        pc = chunk.skewed_end;
+        if (chunk.meet >= 0) {
+          // meet is where an instruction starts, so it can only fall inside a run of metadata
+          auto it = std::partition_point(chunk.runs.begin(), chunk.runs.end(), [&](const opcode_run_t& run) { return run.end <= chunk.meet; });
+          if (it != chunk.runs.end() && it->start < chunk.meet) {
+            map.add_range(base_address + chunk.meet, base_address + it->end, *it->metadata);
+            ++it;
+          }
+          apply(it, chunk.runs.end());
+          pc = chunk.end;
+        }
+      } else if (pc < chunk.stop) {
+        std::vector<opcode_run_t> runs;
+        pc = decode_opcodes(runs, base_address, xlen, bytes, pc, chunk.stop);
+        apply(runs.begin(), runs.end());
+      }
     }
+  } catch (...) {
+    error = std::current_exception();
   }
+  for (std::thread& thread : pool)
+    thread.join();
+  if (error)
+    std::rethrow_exception(error);
 }
 
 void metadata_factory_t::tag_entities(metadata_memory_map_t& md_map, const elf_image_t& img, const std::vector<std::string>& yaml_files, reporter_t& err) {
@@ -63,6 +63,8 @@ void soc_tag_configuration_t::process_element(const std::string& element_name, c
   } else {
     elt.tag_granularity = xlen/8;
   }
+  if (elt.tag_granularity == 0 || (elt.tag_granularity & (elt.tag_granularity - 1)) != 0)
+    throw configuration_exception_t("'tag_granularity' must be a power of two for element " + element_name);
   elt.word_size = xlen/8;
 
   if (n["start"]) {
@@ -79,12 +81,28 @@ void soc_tag_configuration_t::process_element(const std::string& element_name, c
   if (n["heterogeneous"]) {
     elt.heterogeneous = n["heterogeneous"].as<bool>();
   }
+  if (n["tag_storage"]) {
+    std::string storage = n["tag_storage"].as<std::string>();
+    if (storage == "dense")
+      elt.storage = DENSE;
+    else if (storage == "interval")
+      elt.storage = INTERVAL;
+    else
+      throw configuration_exception_t("'tag_storage' must be dense or interval for element " + element_name);
+  }
+  elt.tag_width = tag_width;
   elt.tag = factory->get_tag(elt_path);
   elements.push_back(elt);
 }
 
-soc_tag_configuration_t::soc_tag_configuration_t(meta_set_factory_t* factory, const std::string& file_name, int xlen) : factory(factory) {
+soc_tag_configuration_t::soc_tag_configuration_t(meta_set_factory_t* factory, const std::string& file_name, int xlen) :
+    factory(factory), tag_width(default_tag_width) {
   YAML::Node n = YAML::LoadFile(file_name);
+  if (n["tag_width"]) {
+    tag_width = n["tag_width"].as<size_t>();
+    if (tag_width != 2 && tag_width != 4 && tag_width != 8)
+      throw configuration_exception_t("'tag_width' must be 2, 4 or 8");
+  }
   if (n["SOC"]) {
     for (const auto& it : n["SOC"]) {
       process_element(it.first.as<std::string>(), it.second, xlen);
@@ -94,14 +112,20 @@ soc_tag_configuration_t::soc_tag_configuration_t(meta_set_factory_t* factory, co
   }
 }
 
+std::unique_ptr<tag_provider_t> soc_tag_configuration_t::make_provider(const soc_element_t& e) {
+  if (!e.heterogeneous)
+    return std::make_unique<uniform_tag_provider_t>(e.end - e.start, e.tag, e.tag_granularity);
+  else if (e.storage == INTERVAL)
+    return std::make_unique<interval_tag_provider_t>(e.end - e.start, e.tag, e.tag_granularity);
+  else if (e.end - e.start > paged_threshold)
+    return std::make_unique<paged_tag_provider_t>(e.end - e.start, e.tag, e.tag_granularity, e.tag_width);
+  else
+    return std::make_unique<platform_ram_tag_provider_t>(e.end - e.start, e.tag, e.tag_granularity, e.tag_width);
+}
+
 void soc_tag_configuration_t::apply(tag_bus_t* tag_bus, meta_set_cache_t* ms_cache) {
-  for (const auto& e: elements) {
-    if (e.heterogeneous) {
-      tag_bus->add_provider(e.start, e.end, std::make_unique<platform_ram_tag_provider_t>(e.end - e.start, e.tag, e.word_size, e.tag_granularity));
-    } else {
-      tag_bus->add_provider(e.start, e.end, std::make_unique<uniform_tag_provider_t>(e.end - e.start, e.tag, e.tag_granularity));
-    }
-  }
+  for (const auto& e: elements)
+    tag_bus->add_provider(e.start, e.end, make_provider(e));
 }
 
 } // namespace policy_engine
\ No newline at end of file